@@ -0,0 +1,146 @@
+#include "bandwidth-limit.hpp"
+
+#include "nlohmann/json.hpp"
+
+#include "utils.hpp"
+
+#include <obs-module.h>
+#include <util/platform.h>
+
+#include <algorithm>
+#include <vector>
+
+// how many seconds of its rate a bucket holds
+constexpr double BURST_S = 4.0;
+// a source which read nothing for this long no longer takes a share
+constexpr uint64_t ACTIVE_NS = 3000000000ULL;
+// how often a throttled read looks at `stopping`
+constexpr uint64_t WAIT_STEP_MS = 50;
+
+static std::mutex limits_mutex;
+static std::vector<bandwidth_limit *> limits;
+
+// guards loading, reads only look at `total_cap`
+static std::mutex total_mutex;
+static bool total_loaded{};
+// the file sets one, sources saved by older versions are not looked at then
+static bool total_configured{};
+static std::atomic<uint64_t> total_cap{};
+
+static double weight_of(source_tier tier)
+{
+	switch (tier) {
+	case source_tier::program:
+		return 4.0;
+	case source_tier::preview:
+		return 2.0;
+	default:
+		return 1.0;
+	}
+}
+
+// Called with `total_mutex` held.
+static void total_load()
+{
+	if (total_loaded)
+		return;
+	total_loaded = true;
+
+	char *path = obs_module_config_path(BANDWIDTH_LIMIT_FILE);
+	char *text = path ? os_quick_read_utf8_file(path) : nullptr;
+	if (text) {
+		try {
+			const auto loaded = nlohmann::json::parse(text);
+			if (loaded.is_object() && loaded.contains("total_mbps")) {
+				// Mbps to bytes per second
+				total_cap = loaded["total_mbps"].get<uint64_t>() * 125000;
+				total_configured = true;
+			}
+		}
+		catch (nlohmann::json::exception &ex) {
+			FF_LOG(LOG_WARNING, "Ignoring broken bandwidth limit settings: %s", ex.what());
+		}
+	}
+	bfree(text);
+	bfree(path);
+}
+
+uint64_t bandwidth_limit_total()
+{
+	std::lock_guard lock{total_mutex};
+	total_load();
+	return total_cap;
+}
+
+void bandwidth_limit_adopt_total(const uint64_t cap)
+{
+	std::lock_guard lock{total_mutex};
+	total_load();
+	if (cap > 0 && !total_configured && (total_cap == 0 || cap < total_cap))
+		total_cap = cap;
+}
+
+std::shared_ptr<bandwidth_limit> bandwidth_limit_register()
+{
+	auto bl = std::make_shared<bandwidth_limit>();
+	std::lock_guard lock{limits_mutex};
+	limits.push_back(bl.get());
+	return bl;
+}
+
+void bandwidth_limit_unregister(bandwidth_limit *bl)
+{
+	std::lock_guard lock{limits_mutex};
+	limits.erase(std::remove(limits.begin(), limits.end(), bl), limits.end());
+}
+
+static uint64_t bandwidth_limit_rate(const bandwidth_limit *bl, uint64_t now)
+{
+	double total_weight = 0.0;
+	{
+		std::lock_guard lock{limits_mutex};
+		if (std::find(limits.begin(), limits.end(), bl) == limits.end())
+			return 0;
+		for (const auto other : limits) {
+			if (other == bl || now - other->last_read_ns < ACTIVE_NS)
+				total_weight += weight_of(other->tier);
+		}
+	}
+	auto rate = static_cast<uint64_t>(static_cast<double>(total_cap) * weight_of(bl->tier) / total_weight);
+	const uint64_t source_cap = bl->source_cap;
+	if (source_cap > 0 && (rate == 0 || source_cap < rate))
+		rate = source_cap;
+	return rate;
+}
+
+void bandwidth_limit_take(bandwidth_limit *bl, size_t bytes, const std::function<bool()> &stopping)
+{
+	const uint64_t start_ts = os_gettime_ns();
+	bl->bytes_read += bytes;
+	bl->last_read_ns = start_ts;
+	const uint64_t rate = bandwidth_limit_rate(bl, start_ts);
+	bl->rate = rate;
+
+	uint64_t wait_ns;
+	{
+		std::lock_guard lock{bl->mutex};
+		if (rate == 0) {
+			// starts with a full bucket once limited again
+			bl->tokens_ts = 0;
+			return;
+		}
+		const double burst = static_cast<double>(rate) * BURST_S;
+		bl->tokens = bl->tokens_ts == 0 ? burst
+						: std::min(burst, bl->tokens + static_cast<double>(start_ts - bl->tokens_ts) /
+										 1000000000.0 * static_cast<double>(rate));
+		bl->tokens_ts = start_ts;
+		bl->tokens -= static_cast<double>(bytes);
+		if (bl->tokens >= 0.0)
+			return;
+		wait_ns = static_cast<uint64_t>(-bl->tokens / static_cast<double>(rate) * 1000000000.0);
+	}
+
+	for (uint64_t now = start_ts; now - start_ts < wait_ns && !stopping(); now = os_gettime_ns())
+		os_sleep_ms(static_cast<uint32_t>(std::min(WAIT_STEP_MS, (wait_ns - (now - start_ts)) / 1000000 + 1)));
+	bl->throttled_ns += os_gettime_ns() - start_ts;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// How a source is watched, sources on program get the largest share of the total cap.
+enum class source_tier { hidden, preview, program };
+
+// The module-wide settings in the module's config directory, {"total_mbps": <cap>}, read once.
+constexpr auto BANDWIDTH_LIMIT_FILE = "bandwidth-limit.json";
+
+// Paces what the write threads read, so that every streamlink source together stays under a download cap. Each
+// source has a token bucket filled at its share of the cap, weighted by tier; only sources which read recently count.
+// A bucket holds a few seconds of its rate, so a segment which arrives in one burst is smoothed out instead of held
+// back as long as the stream averages below its share.
+// Streamlink keeps downloading into its ring buffer while reads wait, the source bounds it to a few seconds of `rate`
+// so that the network slows down along with the reads.
+struct bandwidth_limit {
+	// set by the source, the cap in bytes per second, 0 for none
+	std::atomic<source_tier> tier{source_tier::hidden};
+	std::atomic<uint64_t> source_cap{};
+
+	// what is enforced right now, 0 while unlimited
+	std::atomic<uint64_t> rate{};
+	std::atomic<uint64_t> bytes_read{};
+	std::atomic<uint64_t> throttled_ns{};
+	std::atomic<uint64_t> last_read_ns{};
+
+	// a writer left behind may still read next to the current one
+	std::mutex mutex;
+	double tokens{};
+	uint64_t tokens_ts{};
+};
+
+// The cap every registered source shares, in bytes per second, 0 for none. Set in `BANDWIDTH_LIMIT_FILE`.
+uint64_t bandwidth_limit_total();
+// Takes `cap` from a source saved before the total cap was module-wide, unless `BANDWIDTH_LIMIT_FILE` sets one.
+// The lowest one taken applies, as it did back then.
+void bandwidth_limit_adopt_total(uint64_t cap);
+
+// Counted against the total cap until unregistered, a limit which is not registered is never throttled.
+std::shared_ptr<bandwidth_limit> bandwidth_limit_register();
+void bandwidth_limit_unregister(bandwidth_limit *bl);
+
+// Accounts for `bytes` just read and waits until they fit the rate, or until `stopping`.
+void bandwidth_limit_take(bandwidth_limit *bl, size_t bytes, const std::function<bool()> &stopping);
@@ -0,0 +1,102 @@
+#include "buffer-budget.hpp"
+
+#include "utils.hpp"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
+struct buffer_want {
+	size_t wanted;
+	bool fixed;
+};
+
+static std::mutex budget_mutex;
+static std::map<const void *, buffer_want> budget_wants;
+// so that going over the total is logged once each time it happens
+static bool budget_exceeded{};
+
+// Called with `budget_mutex` held.
+static size_t granted(const buffer_want &want)
+{
+	if (want.fixed)
+		return want.wanted;
+	size_t fixed_total = 0;
+	size_t auto_total = 0;
+	std::vector<size_t> autos{};
+	for (const auto &[key, other] : budget_wants) {
+		if (other.fixed) {
+			fixed_total += other.wanted;
+		} else {
+			auto_total += other.wanted;
+			autos.push_back(other.wanted);
+		}
+	}
+	const size_t left = BUFFER_BUDGET_TOTAL > fixed_total ? BUFFER_BUDGET_TOTAL - fixed_total : 0;
+	if (auto_total <= left)
+		return want.wanted;
+	// not even the minimums fit
+	if (autos.size() * BUFFER_BUDGET_MIN >= left)
+		return BUFFER_BUDGET_MIN;
+
+	// Sizes whose share falls under the minimum get the minimum, the others share what is left after them in
+	// proportion. Every minimum handed out shrinks the other shares, so the smallest sizes are taken out first until
+	// the next one's share fits.
+	std::sort(autos.begin(), autos.end());
+	size_t floored = 0;
+	size_t shared = auto_total;
+	const auto scale = [&] {
+		return static_cast<double>(left - floored * BUFFER_BUDGET_MIN) / static_cast<double>(shared);
+	};
+	for (const size_t wanted : autos) {
+		if (static_cast<double>(wanted) * scale() >= static_cast<double>(BUFFER_BUDGET_MIN))
+			break;
+		floored++;
+		shared -= wanted;
+	}
+	const auto share = static_cast<size_t>(static_cast<double>(want.wanted) * scale());
+	return std::max(share, BUFFER_BUDGET_MIN);
+}
+
+// Called with `budget_mutex` held.
+static size_t granted_total()
+{
+	size_t total = 0;
+	for (const auto &[key, want] : budget_wants)
+		total += granted(want);
+	return total;
+}
+
+void buffer_budget_update(const void *source, size_t wanted, bool fixed)
+{
+	std::lock_guard lock{budget_mutex};
+	budget_wants[source] = {wanted, fixed};
+	const size_t total = granted_total();
+	const bool exceeded = total > BUFFER_BUDGET_TOTAL;
+	if (exceeded && !budget_exceeded)
+		FF_LOG(LOG_WARNING, "ring buffers take %zu MiB, over the budget of %zu MiB: fixed sizes or the %zu MiB "
+				    "minimum of every source don't fit",
+		       total / (1024 * 1024), BUFFER_BUDGET_TOTAL / (1024 * 1024), BUFFER_BUDGET_MIN / (1024 * 1024));
+	budget_exceeded = exceeded;
+}
+
+void buffer_budget_remove(const void *source)
+{
+	std::lock_guard lock{budget_mutex};
+	budget_wants.erase(source);
+	budget_exceeded = budget_exceeded && granted_total() > BUFFER_BUDGET_TOTAL;
+}
+
+size_t buffer_budget_size(const void *source)
+{
+	std::lock_guard lock{budget_mutex};
+	const auto it = budget_wants.find(source);
+	return it != budget_wants.end() ? granted(it->second) : 0;
+}
+
+size_t buffer_budget_total()
+{
+	std::lock_guard lock{budget_mutex};
+	return granted_total();
+}
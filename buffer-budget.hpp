@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+
+// Bounds the memory streamlink's ring buffers may take across every source. Sources with a fixed size get it as
+// configured, sizes picked automatically share what is left and shrink in proportion when they would not fit, those
+// which would fall under the minimum taking it out of the others' shares.
+// Only fixed sizes, or more sources than minimums fit, can take the total over; that is logged when it happens.
+constexpr size_t BUFFER_BUDGET_TOTAL = 1024 * 1024 * 1024;
+// an automatic size never goes below this, so that a segment of a low bitrate stream still fits
+constexpr size_t BUFFER_BUDGET_MIN = 1024 * 1024;
+
+void buffer_budget_update(const void *source, size_t wanted, bool fixed);
+void buffer_budget_remove(const void *source);
+// What `source` may use, 0 when it is not registered.
+size_t buffer_budget_size(const void *source);
+// Everything granted to all sources together.
+size_t buffer_budget_total();
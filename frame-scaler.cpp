@@ -0,0 +1,124 @@
+#include "frame-scaler.hpp"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+#include <libswscale/swscale.h>
+}
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+static AVPixelFormat pixel_format_of(const video_format format)
+{
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+		return AV_PIX_FMT_YUV420P;
+	case VIDEO_FORMAT_NV12:
+		return AV_PIX_FMT_NV12;
+	case VIDEO_FORMAT_YUY2:
+		return AV_PIX_FMT_YUYV422;
+	case VIDEO_FORMAT_UYVY:
+		return AV_PIX_FMT_UYVY422;
+	case VIDEO_FORMAT_RGBA:
+		return AV_PIX_FMT_RGBA;
+	case VIDEO_FORMAT_BGRA:
+		return AV_PIX_FMT_BGRA;
+	case VIDEO_FORMAT_BGRX:
+		return AV_PIX_FMT_BGR0;
+	case VIDEO_FORMAT_Y800:
+		return AV_PIX_FMT_GRAY8;
+	case VIDEO_FORMAT_I444:
+		return AV_PIX_FMT_YUV444P;
+	case VIDEO_FORMAT_I422:
+		return AV_PIX_FMT_YUV422P;
+	case VIDEO_FORMAT_I010:
+		return AV_PIX_FMT_YUV420P10LE;
+	case VIDEO_FORMAT_P010:
+		return AV_PIX_FMT_P010LE;
+	default:
+		// alpha and the rarer high bit depth layouts just pass through unscaled
+		return AV_PIX_FMT_NONE;
+	}
+}
+
+static void release_output(frame_scaler &scaler)
+{
+	av_freep(&scaler.planes[0]);
+	std::fill(std::begin(scaler.planes), std::end(scaler.planes), nullptr);
+	scaler.format = VIDEO_FORMAT_NONE;
+}
+
+frame_scaler::~frame_scaler()
+{
+	release_output(*this);
+	sws_freeContext(sws);
+}
+
+// Keeps the aspect ratio, and even sizes, which every chroma subsampling is happy with.
+static void fit(const obs_source_frame *in, uint32_t max_width, uint32_t max_height, uint32_t &width, uint32_t &height)
+{
+	double factor = 1.0;
+	if (max_width > 0)
+		factor = std::min(factor, static_cast<double>(max_width) / in->width);
+	if (max_height > 0)
+		factor = std::min(factor, static_cast<double>(max_height) / in->height);
+	width = std::max(2u, static_cast<uint32_t>(std::lround(in->width * factor)) & ~1u);
+	height = std::max(2u, static_cast<uint32_t>(std::lround(in->height * factor)) & ~1u);
+}
+
+const obs_source_frame *frame_scaler_scale(frame_scaler &scaler, const obs_source_frame *in, uint32_t max_width,
+					   uint32_t max_height)
+{
+	if (!in || (max_width == 0 && max_height == 0))
+		return in;
+	if ((max_width == 0 || in->width <= max_width) && (max_height == 0 || in->height <= max_height))
+		return in;
+	const auto pix_fmt = pixel_format_of(in->format);
+	if (pix_fmt == AV_PIX_FMT_NONE)
+		return in;
+
+	uint32_t width, height;
+	fit(in, max_width, max_height, width, height);
+
+	if (scaler.format != in->format || scaler.in_width != in->width || scaler.in_height != in->height ||
+	    scaler.out_width != width || scaler.out_height != height) {
+		release_output(scaler);
+		if (av_image_alloc(scaler.planes, scaler.linesizes, static_cast<int>(width), static_cast<int>(height), pix_fmt,
+				   32) < 0)
+			return in;
+
+		// area averaging, the frames are always made smaller here
+		scaler.sws = sws_getCachedContext(scaler.sws, static_cast<int>(in->width), static_cast<int>(in->height), pix_fmt,
+						  static_cast<int>(width), static_cast<int>(height), pix_fmt, SWS_AREA, nullptr,
+						  nullptr, nullptr);
+		if (!scaler.sws) {
+			release_output(scaler);
+			return in;
+		}
+		scaler.format = in->format;
+		scaler.in_width = in->width;
+		scaler.in_height = in->height;
+		scaler.out_width = width;
+		scaler.out_height = height;
+	}
+
+	const uint8_t *src[4];
+	int src_linesizes[4];
+	for (int i = 0; i < 4; i++) {
+		src[i] = in->data[i];
+		src_linesizes[i] = static_cast<int>(in->linesize[i]);
+	}
+	sws_scale(scaler.sws, src, src_linesizes, 0, static_cast<int>(in->height), scaler.planes, scaler.linesizes);
+
+	// everything but the pixels stays as decoded: timestamp, color matrix and range, transfer, flip
+	scaler.out = *in;
+	for (int i = 0; i < MAX_AV_PLANES; i++) {
+		scaler.out.data[i] = i < 4 ? scaler.planes[i] : nullptr;
+		scaler.out.linesize[i] = i < 4 ? static_cast<uint32_t>(scaler.linesizes[i]) : 0;
+	}
+	scaler.out.width = width;
+	scaler.out.height = height;
+	return &scaler.out;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <obs.h>
+
+struct SwsContext;
+
+// Scales decoded frames down on the media thread, before OBS copies and uploads them.
+// The swscale context is kept while the sizes and format stay the same, and so is the output frame: a single one is
+// enough, because `obs_source_output_video` copies what it is given.
+struct frame_scaler {
+	SwsContext *sws{};
+	uint8_t *planes[4]{};
+	int linesizes[4]{};
+	obs_source_frame out{};
+	// what `sws` and `planes` were set up for
+	video_format format{VIDEO_FORMAT_NONE};
+	uint32_t in_width{};
+	uint32_t in_height{};
+	uint32_t out_width{};
+	uint32_t out_height{};
+
+	frame_scaler() = default;
+	~frame_scaler();
+
+	frame_scaler(const frame_scaler &) = delete;
+	frame_scaler &operator=(const frame_scaler &) = delete;
+};
+
+// Returns `in` itself when it already fits into `max_width` x `max_height` (0 for no limit), or when its format can't
+// be scaled. Otherwise a frame owned by `scaler`, valid until the next call, with the aspect ratio kept.
+const obs_source_frame *frame_scaler_scale(frame_scaler &scaler, const obs_source_frame *in, uint32_t max_width,
+					   uint32_t max_height);
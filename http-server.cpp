@@ -0,0 +1,304 @@
+// before anything which could pull in windows.h
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "http-server.hpp"
+#include "utils.hpp"
+
+#include <util/platform.h>
+
+#include <chrono>
+#include <cstring>
+
+// how often blocked threads look at `stopping`
+constexpr int POLL_INTERVAL_MS = 200;
+// a client which sends no request within this long is let go
+constexpr int REQUEST_TIMEOUT_MS = 5000;
+
+#ifdef _WIN32
+using socket_t = SOCKET;
+constexpr socket_t NO_SOCKET = INVALID_SOCKET;
+static int socket_poll(pollfd *fds, unsigned long count, int timeout_ms)
+{
+	return WSAPoll(fds, count, timeout_ms);
+}
+static void socket_close(socket_t sock)
+{
+	closesocket(sock);
+}
+#else
+using socket_t = int;
+constexpr socket_t NO_SOCKET = -1;
+static int socket_poll(pollfd *fds, nfds_t count, int timeout_ms)
+{
+	return poll(fds, count, timeout_ms);
+}
+static void socket_close(socket_t sock)
+{
+	close(sock);
+}
+#endif
+
+static std::mutex running_mutex;
+static std::condition_variable running_cv;
+static unsigned running = 0;
+
+struct http_client {
+	std::shared_ptr<http_server> server;
+	socket_t sock;
+};
+
+static bool http_stopping(http_server *hs)
+{
+	std::lock_guard lock{hs->mutex};
+	return hs->stopping;
+}
+
+static void thread_exit()
+{
+	std::lock_guard running_lock{running_mutex};
+	running--;
+	running_cv.notify_all();
+}
+
+static bool thread_launch(void *(*func)(void *), void *data)
+{
+	{
+		std::lock_guard running_lock{running_mutex};
+		running++;
+	}
+	pthread_t thread;
+	if (pthread_create(&thread, nullptr, func, data) != 0) {
+		thread_exit();
+		return false;
+	}
+	pthread_detach(thread);
+	return true;
+}
+
+// The request itself doesn't matter, every path serves the same stream. Waits for the end of its headers only so
+// that the client is not answered before it is done asking.
+static bool http_read_request(http_server *hs, socket_t sock)
+{
+	std::string request{};
+	char buf[1024];
+	for (int waited = 0; waited < REQUEST_TIMEOUT_MS && !http_stopping(hs); waited += POLL_INTERVAL_MS) {
+		pollfd pfd{sock, POLLIN, 0};
+		const int ready = socket_poll(&pfd, 1, POLL_INTERVAL_MS);
+		if (ready < 0)
+			return false;
+		if (ready == 0)
+			continue;
+		const auto received = recv(sock, buf, sizeof(buf), 0);
+		if (received <= 0)
+			return false;
+		request.append(buf, static_cast<size_t>(received));
+		if (request.find("\r\n\r\n") != std::string::npos)
+			return true;
+		if (request.size() > 16 * 1024)
+			return false;
+	}
+	return false;
+}
+
+static bool http_send(http_server *hs, socket_t sock, const char *buf, size_t len)
+{
+#ifdef MSG_NOSIGNAL
+	constexpr int flags = MSG_NOSIGNAL;
+#else
+	constexpr int flags = 0;
+#endif
+	while (len > 0) {
+		if (http_stopping(hs))
+			return false;
+		pollfd pfd{sock, POLLOUT, 0};
+		const int ready = socket_poll(&pfd, 1, POLL_INTERVAL_MS);
+		if (ready < 0)
+			return false;
+		if (ready == 0)
+			continue;
+		const auto sent = send(sock, buf, static_cast<int>(std::min<size_t>(len, 1 << 20)), flags);
+		if (sent <= 0)
+			return false;
+		buf += sent;
+		len -= static_cast<size_t>(sent);
+	}
+	return true;
+}
+
+static void *http_client_thread(void *data)
+{
+	os_set_thread_name("http_client_thread");
+
+	const auto client = std::unique_ptr<http_client>(static_cast<http_client*>(data));
+	const auto hs = client->server;
+	const auto sock = client->sock;
+	hs->clients++;
+	FF_LOG_N(hs->name.c_str(), LOG_INFO, "serving: client connected, %u now", hs->clients.load());
+
+	static constexpr char header[] = "HTTP/1.1 200 OK\r\n"
+					 "Content-Type: video/mp2t\r\n"
+					 "Cache-Control: no-cache\r\n"
+					 "Connection: close\r\n"
+					 "\r\n";
+	bool ok = http_read_request(hs.get(), sock) && http_send(hs.get(), sock, header, sizeof(header) - 1);
+
+	// starts with what comes next, a TS player finds its way in at the next PAT/PMT
+	uint64_t cursor;
+	{
+		std::lock_guard lock{hs->mutex};
+		cursor = hs->first_seq + hs->chunks.size();
+	}
+	while (ok) {
+		std::shared_ptr<const std::vector<char>> chunk;
+		{
+			std::unique_lock lock{hs->mutex};
+			hs->cv.wait_for(lock, std::chrono::milliseconds(POLL_INTERVAL_MS),
+					[&] { return hs->stopping || cursor < hs->first_seq + hs->chunks.size(); });
+			if (hs->stopping)
+				break;
+			if (cursor >= hs->first_seq + hs->chunks.size())
+				continue;
+			if (cursor < hs->first_seq) {
+				// this client can't keep up, it goes on with the latest chunk
+				FF_LOG_N(hs->name.c_str(), LOG_INFO, "serving: a client fell behind, skipping %llu chunk(s)",
+					 static_cast<unsigned long long>(hs->first_seq + hs->chunks.size() - 1 - cursor));
+				cursor = hs->first_seq + hs->chunks.size() - 1;
+			}
+			chunk = hs->chunks[static_cast<size_t>(cursor - hs->first_seq)];
+			cursor++;
+		}
+		ok = http_send(hs.get(), sock, chunk->data(), chunk->size());
+		if (ok)
+			hs->bytes_sent += chunk->size();
+	}
+
+	socket_close(sock);
+	hs->clients--;
+	FF_LOG_N(hs->name.c_str(), LOG_INFO, "serving: client disconnected, %u left", hs->clients.load());
+	thread_exit();
+	return nullptr;
+}
+
+static void *http_accept_thread(void *data)
+{
+	os_set_thread_name("http_accept_thread");
+
+	const auto hs = std::move(*static_cast<std::shared_ptr<http_server>*>(data));
+	delete static_cast<std::shared_ptr<http_server>*>(data);
+	const auto listener = static_cast<socket_t>(hs->listener);
+
+	while (!http_stopping(hs.get())) {
+		pollfd pfd{listener, POLLIN, 0};
+		const int ready = socket_poll(&pfd, 1, POLL_INTERVAL_MS);
+		if (ready < 0) {
+			FF_LOG_N(hs->name.c_str(), LOG_WARNING, "serving: poll failed, no longer accepting clients");
+			break;
+		}
+		if (ready == 0)
+			continue;
+		const socket_t sock = accept(listener, nullptr, nullptr);
+		if (sock == NO_SOCKET)
+			continue;
+#ifdef SO_NOSIGPIPE
+		const int on = 1;
+		setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+		auto client = new http_client{hs, sock};
+		if (!thread_launch(http_client_thread, client)) {
+			socket_close(sock);
+			delete client;
+		}
+	}
+
+	socket_close(listener);
+	thread_exit();
+	return nullptr;
+}
+
+std::shared_ptr<http_server> http_server_start(const char *name, uint16_t port, size_t limit, bool retry)
+{
+#ifdef _WIN32
+	static const bool wsa_ready = [] {
+		WSADATA wsa;
+		return WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+	}();
+	if (!wsa_ready)
+		return nullptr;
+#endif
+	const socket_t listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == NO_SOCKET) {
+		FF_LOG_N(name, LOG_WARNING, "serving: failed to create a socket");
+		return nullptr;
+	}
+	const int on = 1;
+#ifdef _WIN32
+	// SO_REUSEADDR would let another listener take the same port on Windows, this makes the bind fail instead
+	setsockopt(listener, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, reinterpret_cast<const char*>(&on), sizeof(on));
+#else
+	// only to bind again right after a restart, while connections of the previous listener are in TIME_WAIT
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+#endif
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 8) != 0) {
+		FF_LOG_N(name, retry ? LOG_DEBUG : LOG_WARNING, "serving: failed to listen on port %u, it may be in use",
+			 static_cast<unsigned>(port));
+		socket_close(listener);
+		return nullptr;
+	}
+
+	auto hs = std::make_shared<http_server>();
+	hs->name = name;
+	hs->port = port;
+	hs->limit = limit;
+	hs->listener = listener;
+	auto thread_data = new std::shared_ptr<http_server>(hs);
+	if (!thread_launch(http_accept_thread, thread_data)) {
+		delete thread_data;
+		socket_close(listener);
+		return nullptr;
+	}
+	FF_LOG_N(name, LOG_INFO, "serving on http://127.0.0.1:%u/", static_cast<unsigned>(port));
+	return hs;
+}
+
+void http_server_stop(const std::shared_ptr<http_server> &hs)
+{
+	std::lock_guard lock{hs->mutex};
+	hs->stopping = true;
+	hs->chunks.clear();
+	hs->cv.notify_all();
+}
+
+void http_server_push(http_server *hs, std::shared_ptr<const std::vector<char>> chunk)
+{
+	std::lock_guard lock{hs->mutex};
+	if (hs->stopping)
+		return;
+	hs->bytes += chunk->size();
+	hs->chunks.push_back(std::move(chunk));
+	while (hs->chunks.size() > 1 && hs->bytes > hs->limit) {
+		hs->bytes -= hs->chunks.front()->size();
+		hs->chunks.pop_front();
+		hs->first_seq++;
+	}
+	hs->cv.notify_all();
+}
+
+void http_server_shutdown()
+{
+	std::unique_lock lock{running_mutex};
+	running_cv.wait(lock, [] { return running == 0; });
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <util/threading.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Serves what a source reads, as is, over HTTP on the loopback interface, so that other local tools can play the
+// same feed without fetching it again. Every client reads the same chunks through a cursor of its own; one which
+// falls behind skips ahead instead of holding the others up.
+struct http_server {
+	std::string name{};
+	uint16_t port{};
+	size_t limit{};
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<std::shared_ptr<const std::vector<char>>> chunks{};
+	// sequence number of the oldest chunk kept
+	uint64_t first_seq{};
+	size_t bytes{};
+	bool stopping{};
+
+#ifdef _WIN32
+	uintptr_t listener{~uintptr_t{0}}; // a SOCKET
+#else
+	int listener{-1};
+#endif
+
+	std::atomic<unsigned> clients{};
+	std::atomic<uint64_t> bytes_sent{};
+};
+
+// Listens on 127.0.0.1:`port`. Null when the port can't be bound or the thread could not be started; a failed bind
+// is only logged at debug level when `retry`, the caller having reported it the first time already.
+std::shared_ptr<http_server> http_server_start(const char *name, uint16_t port, size_t limit, bool retry = false);
+// Disconnects every client, the threads leave on their own, see `http_server_shutdown`.
+void http_server_stop(const std::shared_ptr<http_server> &hs);
+// Never blocks on the clients; the oldest chunks go once more than `limit` bytes are kept.
+void http_server_push(http_server *hs, std::shared_ptr<const std::vector<char>> chunk);
+
+// Waits for the threads of every stopped server, before the module goes away.
+void http_server_shutdown();
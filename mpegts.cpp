@@ -0,0 +1,272 @@
+#include "mpegts.hpp"
+
+#include <algorithm>
+
+namespace mpegts {
+    // give up looking for sync after this much input, and pass everything through as is
+    constexpr size_t MaxProbeSize = 64 * 1024;
+
+    StreamKind KindOf(const uint8_t streamType)
+    {
+        switch (streamType) {
+        case 0x01: // MPEG-1 video
+        case 0x02: // MPEG-2 video
+        case 0x10: // MPEG-4 part 2
+        case 0x1B: // H.264
+        case 0x24: // HEVC
+        case 0x33: // VVC
+            return StreamKind::Video;
+        case 0x03: // MPEG-1 audio
+        case 0x04: // MPEG-2 audio
+        case 0x0F: // AAC ADTS
+        case 0x11: // AAC LATM
+        case 0x81: // AC-3
+        case 0x87: // E-AC-3
+            return StreamKind::Audio;
+        default:
+            return StreamKind::Other;
+        }
+    }
+
+    // Looks for a NAL unit / start code in the first packet of a PES, for muxers that don't set random_access_indicator.
+    static bool HasKeyframeStart(const uint8_t* payload, const size_t size, const uint8_t streamType)
+    {
+        if (size < 9 || payload[0] != 0 || payload[1] != 0 || payload[2] != 1)
+            return false;
+        const size_t esStart = 9 + static_cast<size_t>(payload[8]);
+        for (size_t i = esStart; i + 3 < size; i++) {
+            if (payload[i] != 0 || payload[i + 1] != 0 || payload[i + 2] != 1)
+                continue;
+            const uint8_t nal = payload[i + 3];
+            switch (streamType) {
+            case 0x1B: {
+                const uint8_t type = nal & 0x1F;
+                if (type == 5 || type == 7) // IDR slice, SPS
+                    return true;
+                break;
+            }
+            case 0x24: {
+                const uint8_t type = (nal >> 1) & 0x3F;
+                if ((type >= 16 && type <= 21) || (type >= 32 && type <= 34)) // IRAP slices, VPS/SPS/PPS
+                    return true;
+                break;
+            }
+            case 0x01:
+            case 0x02:
+                if (nal == 0xB3) // sequence header
+                    return true;
+                break;
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    // Returns the start of the section in a PSI packet, and its length including the header, or null.
+    static const uint8_t* SectionOf(const uint8_t* packet, size_t payloadOffset, size_t& sectionSize)
+    {
+        if (payloadOffset >= PacketSize)
+            return nullptr;
+        const size_t start = payloadOffset + 1 + packet[payloadOffset];
+        if (start + 3 > PacketSize)
+            return nullptr;
+        const uint8_t* section = packet + start;
+        sectionSize = 3 + (((section[1] & 0x0F) << 8) | section[2]);
+        if (start + sectionSize > PacketSize || sectionSize < 12)
+            return nullptr;
+        return section;
+    }
+
+    static size_t PayloadOffset(const uint8_t* packet)
+    {
+        const uint8_t afc = (packet[3] >> 4) & 0x3;
+        return (afc & 0x2) ? 5 + static_cast<size_t>(packet[4]) : 4;
+    }
+
+    uint32_t Crc32(const uint8_t* data, const size_t size)
+    {
+        uint32_t crc = 0xFFFFFFFF;
+        for (size_t i = 0; i < size; i++) {
+            crc ^= static_cast<uint32_t>(data[i]) << 24;
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+        return crc;
+    }
+
+    bool DropFromPmt(uint8_t* packet, const StreamKind kind)
+    {
+        if (!(packet[1] & 0x40))
+            return false;
+        size_t size;
+        const auto section = SectionOf(packet, PayloadOffset(packet), size);
+        if (!section || section[0] != 0x02)
+            return false;
+        const size_t programInfoLength = ((section[10] & 0x0F) << 8) | section[11];
+        if (12 + programInfoLength > size - 4)
+            return false;
+
+        const uint16_t pcrPid = ((section[8] & 0x1F) << 8) | section[9];
+        bool pcrDropped = false;
+        std::vector<uint8_t> kept(section, section + 12 + programInfoLength);
+        for (size_t i = 12 + programInfoLength; i + 5 <= size - 4;) {
+            const uint16_t pid = ((section[i + 1] & 0x1F) << 8) | section[i + 2];
+            const size_t entrySize = 5 + (((section[i + 3] & 0x0F) << 8) | section[i + 4]);
+            if (i + entrySize > size - 4)
+                return false;
+            if (KindOf(section[i]) == kind)
+                pcrDropped |= pid == pcrPid;
+            else
+                kept.insert(kept.end(), section + i, section + i + entrySize);
+            i += entrySize;
+        }
+        if (kept.size() + 4 == size)
+            return true;
+
+        if (pcrDropped) {
+            kept[8] |= 0x1F;
+            kept[9] = 0xFF;
+        }
+        const size_t sectionLength = kept.size() + 4 - 3;
+        kept[1] = static_cast<uint8_t>((kept[1] & 0xF0) | (sectionLength >> 8));
+        kept[2] = static_cast<uint8_t>(sectionLength & 0xFF);
+        const uint32_t crc = Crc32(kept.data(), kept.size());
+        for (int shift = 24; shift >= 0; shift -= 8)
+            kept.push_back(static_cast<uint8_t>(crc >> shift));
+
+        // the rest of the packet is stuffing
+        const auto start = const_cast<uint8_t*>(section);
+        std::copy(kept.begin(), kept.end(), start);
+        std::fill(start + kept.size(), packet + PacketSize, 0xFF);
+        return true;
+    }
+
+    void Inspector::ParsePat(const uint8_t* packet)
+    {
+        size_t size;
+        const auto section = SectionOf(packet, PayloadOffset(packet), size);
+        if (!section || section[0] != 0x00)
+            return;
+        // the CRC takes the last 4 bytes
+        for (size_t i = 8; i + 4 <= size - 4; i += 4) {
+            const uint16_t program = (section[i] << 8) | section[i + 1];
+            if (program == 0)
+                continue; // network PID
+            const uint16_t pid = ((section[i + 2] & 0x1F) << 8) | section[i + 3];
+            if (pid != pmtPid) {
+                pmtPid = pid;
+                streams.clear();
+                lastPmt.clear();
+            }
+            break;
+        }
+    }
+
+    void Inspector::ParsePmt(const uint8_t* packet)
+    {
+        size_t size;
+        const auto section = SectionOf(packet, PayloadOffset(packet), size);
+        if (!section || section[0] != 0x02)
+            return;
+        const size_t programInfoLength = ((section[10] & 0x0F) << 8) | section[11];
+        std::vector<ElementaryStream> parsed{};
+        for (size_t i = 12 + programInfoLength; i + 5 <= size - 4;) {
+            const uint8_t streamType = section[i];
+            const uint16_t pid = ((section[i + 1] & 0x1F) << 8) | section[i + 2];
+            const size_t esInfoLength = ((section[i + 3] & 0x0F) << 8) | section[i + 4];
+            parsed.push_back({pid, streamType});
+            i += 5 + esInfoLength;
+        }
+        streams = std::move(parsed);
+    }
+
+    PacketInfo Inspector::Inspect(const uint8_t* packet)
+    {
+        PacketInfo info{};
+        info.pid = ((packet[1] & 0x1F) << 8) | packet[2];
+        info.unitStart = (packet[1] & 0x40) != 0;
+        info.kind = StreamKind::Other;
+
+        if (info.pid == PatPid) {
+            info.isPat = true;
+            if (info.unitStart)
+                ParsePat(packet);
+            lastPat.assign(packet, packet + PacketSize);
+            return info;
+        }
+        if (info.pid == pmtPid) {
+            info.isPmt = true;
+            if (info.unitStart)
+                ParsePmt(packet);
+            lastPmt.assign(packet, packet + PacketSize);
+            return info;
+        }
+
+        uint8_t streamType = 0;
+        for (const auto& es : streams) {
+            if (es.pid == info.pid) {
+                streamType = es.streamType;
+                info.kind = KindOf(es.streamType);
+                break;
+            }
+        }
+        if (info.kind == StreamKind::Other || !info.unitStart)
+            return info;
+
+        const uint8_t afc = (packet[3] >> 4) & 0x3;
+        const size_t payloadOffset = PayloadOffset(packet);
+        const uint8_t* pes = (afc & 0x1) && payloadOffset + 14 <= PacketSize ? packet + payloadOffset : nullptr;
+        if (pes && pes[0] == 0 && pes[1] == 0 && pes[2] == 1 && (pes[7] & 0x80)) {
+            info.hasPts = true;
+            info.pts = (static_cast<uint64_t>((pes[9] >> 1) & 0x07) << 30) | (static_cast<uint64_t>(pes[10]) << 22) |
+                (static_cast<uint64_t>(pes[11] >> 1) << 15) | (static_cast<uint64_t>(pes[12]) << 7) | (pes[13] >> 1);
+        }
+        if (info.kind != StreamKind::Video)
+            return info;
+
+        const bool randomAccessIndicator = (afc & 0x2) && packet[4] > 0 && (packet[5] & 0x40);
+        info.randomAccess = randomAccessIndicator ||
+            ((afc & 0x1) && payloadOffset < PacketSize &&
+             HasKeyframeStart(packet + payloadOffset, PacketSize - payloadOffset, streamType));
+        return info;
+    }
+
+    void Inspector::Feed(const char* data, const size_t size, const PacketSink& sink)
+    {
+        if (notTs) {
+            sink(reinterpret_cast<const uint8_t*>(data), size, nullptr);
+            return;
+        }
+
+        pending.insert(pending.end(), data, data + size);
+        size_t pos = 0;
+        while (pending.size() - pos >= PacketSize) {
+            const bool nextAvailable = pending.size() - pos >= 2 * PacketSize;
+            if (pending[pos] != SyncByte || (nextAvailable && pending[pos + PacketSize] != SyncByte)) {
+                pos++;
+                skipped++;
+                if (!synced && ++probed > MaxProbeSize) {
+                    notTs = true;
+                    sink(pending.data(), pending.size(), nullptr);
+                    pending.clear();
+                    return;
+                }
+                continue;
+            }
+            synced = true;
+            const auto info = Inspect(&pending[pos]);
+            sink(&pending[pos], PacketSize, &info);
+            pos += PacketSize;
+        }
+        pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(pos));
+    }
+
+    uint16_t Inspector::VideoPid() const
+    {
+        for (const auto& es : streams)
+            if (KindOf(es.streamType) == StreamKind::Video)
+                return es.pid;
+        return NullPid;
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Just enough MPEG-TS understanding to find programs and random access points in the bytes we pass to FFmpeg.
+namespace mpegts {
+    constexpr size_t PacketSize = 188;
+    constexpr uint8_t SyncByte = 0x47;
+    constexpr uint16_t PatPid = 0x0000;
+    constexpr uint16_t NullPid = 0x1FFF;
+    // PTS and DTS are 33 bits wide and wrap around
+    constexpr uint64_t PtsMask = (1ULL << 33) - 1;
+
+    enum class StreamKind { Video, Audio, Other };
+    StreamKind KindOf(uint8_t streamType);
+
+    // CRC-32/MPEG-2, as found at the end of every PSI section.
+    uint32_t Crc32(const uint8_t* data, size_t size);
+    // Rewrites a PMT packet in place so that it no longer lists streams of `kind`; the PCR is dropped along with
+    // its stream. Returns false, leaving the packet as is, for anything but a PMT which fits in one packet.
+    bool DropFromPmt(uint8_t* packet, StreamKind kind);
+
+    struct ElementaryStream {
+        uint16_t pid;
+        uint8_t streamType;
+
+        bool operator==(const ElementaryStream&) const = default;
+    };
+
+    struct PacketInfo {
+        uint16_t pid;
+        bool unitStart;
+        bool isPat;
+        bool isPmt;
+        StreamKind kind;
+        // first packet of a video access unit which can be decoded on its own
+        bool randomAccess;
+        // PTS in 90 kHz units, only looked for at the start of an audio or video PES
+        bool hasPts;
+        uint64_t pts;
+    };
+
+    // `info` is null for bytes passed through untouched, because the input turned out not to be MPEG-TS.
+    using PacketSink = std::function<void(const uint8_t* data, size_t size, const PacketInfo* info)>;
+
+    class Inspector {
+        std::vector<uint8_t> pending;
+        bool synced = false;
+        bool notTs = false;
+        size_t probed = 0;
+        uint64_t skipped = 0;
+
+        uint16_t pmtPid = NullPid;
+        std::vector<ElementaryStream> streams;
+        std::vector<uint8_t> lastPat;
+        std::vector<uint8_t> lastPmt;
+
+        void ParsePat(const uint8_t* packet);
+        void ParsePmt(const uint8_t* packet);
+        PacketInfo Inspect(const uint8_t* packet);
+    public:
+        // Splits arbitrary chunks into aligned packets, resyncing after garbage.
+        void Feed(const char* data, size_t size, const PacketSink& sink);
+
+        bool IsTs() const { return synced && !notTs; }
+        bool IsNotTs() const { return notTs; }
+        // bytes dropped while looking for sync, the rest comes out of `Feed` in order
+        uint64_t Skipped() const { return skipped; }
+        // the start of a packet held back until the rest of it arrives
+        const std::vector<uint8_t>& Pending() const { return pending; }
+        const std::vector<ElementaryStream>& Streams() const { return streams; }
+        uint16_t VideoPid() const;
+
+        // most recent PAT/PMT packets, empty until seen
+        const std::vector<uint8_t>& LastPat() const { return lastPat; }
+        const std::vector<uint8_t>& LastPmt() const { return lastPmt; }
+    };
+}
@@ -4,7 +4,11 @@
 
 #include <obs-module.h>
 
+#include "http-server.hpp"
+#include "pipe-writer.hpp"
 #include "python-streamlink.h"
+#include "recorder.hpp"
+#include "worker-pool.hpp"
 
 OBS_DECLARE_MODULE()
 OBS_MODULE_USE_DEFAULT_LOCALE("obs-streamlink", "en-US")
@@ -33,3 +37,10 @@ bool obs_module_load(void)
 	return true;
 }
 
+void obs_module_unload(void)
+{
+	worker_pool_shutdown();
+	pipe_writer_shutdown();
+	recorder_shutdown();
+	http_server_shutdown();
+}
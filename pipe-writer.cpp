@@ -0,0 +1,1110 @@
+#include "pipe-writer.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include "utils.hpp"
+
+#include <util/platform.h>
+
+#include <algorithm>
+#include <filesystem>
+
+// Give up waiting for a keyframe of the old stream after this long, and splice at once.
+constexpr uint64_t SPLICE_DEADLINE_NS = 5000000000ULL;
+// A GOP larger than this means something is wrong with the new stream.
+constexpr size_t MAX_SPLICE_STAGED = 32 * 1024 * 1024;
+
+// Stop holding data back for a keyframe after this long, some muxers mark none that we recognize.
+constexpr uint64_t GATE_DEADLINE_NS = 10000000000ULL;
+
+constexpr size_t READ_SIZE = 1024 * 1024; /* TODO: configurable */
+
+// Nothing to read for this long, after data came in before, and playback has certainly run dry.
+constexpr uint64_t STALL_NS = 2000000000ULL;
+
+// A definition being opened in the background, to be spliced in by the write thread once it holds a keyframe.
+struct splice_candidate {
+	// held by the switch thread while reading, so the write thread takes over only between reads
+	std::mutex mutex;
+	std::shared_ptr<streamlink::Stream> stream;
+	mpegts::Inspector inspector;
+	keyframe_state keyframes{};
+	// latest PAT and PMT followed by every packet since the latest keyframe
+	std::vector<char> staged{};
+	// the same as read, for the tees, when the filter leaves anything out of `staged`
+	std::vector<char> staged_unfiltered{};
+	bool taken{};
+};
+
+// writers which did not stop in time, they may still call into Python until they are joined
+static std::mutex abandoned_mutex;
+static std::vector<std::shared_ptr<pipe_writer>> abandoned;
+
+pipe_writer::~pipe_writer()
+{
+	if (stop_signal)
+		os_event_destroy(stop_signal);
+	if (exited_signal)
+		os_event_destroy(exited_signal);
+	if (shift_wake)
+		os_event_destroy(shift_wake);
+}
+
+static std::string pipe_current_path(pipe_writer *w)
+{
+	std::lock_guard lock{w->pipe_mutex};
+	return w->pipe_path;
+}
+
+// the pipe is not wanted any more, stop waiting for it or writing into it
+static bool pipe_unwanted(pipe_writer *w)
+{
+	return w->stopping() || w->warm || w->shift_release;
+}
+
+#ifdef _WIN32
+static bool pipe_wait_overlapped(pipe_writer *w, HANDLE pipe, OVERLAPPED *ov)
+{
+	while (WaitForSingleObject(ov->hEvent, w->interval_ms) == WAIT_TIMEOUT) {
+		if (pipe_unwanted(w)) {
+			DWORD ignored;
+			CancelIoEx(pipe, ov);
+			GetOverlappedResult(pipe, ov, &ignored, TRUE);
+			return false;
+		}
+	}
+	return true;
+}
+
+// Created up front rather than by the write thread, so it exists by the time FFmpeg goes looking for it.
+static bool pipe_create(pipe_writer *w, const std::string &path)
+{
+	std::lock_guard lock{w->pipe_mutex};
+	auto pipe = CreateNamedPipe(
+		path.c_str(),
+		PIPE_ACCESS_OUTBOUND | FILE_FLAG_OVERLAPPED,
+		PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+		PIPE_UNLIMITED_INSTANCES,
+		0,
+		0,
+		0,
+		nullptr
+	);
+	if (pipe == INVALID_HANDLE_VALUE) {
+		FF_LOG_N(w->source_name.c_str(), LOG_WARNING, "CreateNamedPipe: %lu", GetLastError());
+		return false;
+	}
+	w->pipe = pipe;
+	return true;
+}
+
+static bool pipe_connect(pipe_writer *w, const std::string &path)
+{
+	UNUSED_PARAMETER(path);
+	OVERLAPPED ov{};
+	ov.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	bool connected = ConnectNamedPipe(w->pipe, &ov) != FALSE;
+	if (!connected) {
+		auto ec = GetLastError();
+		if (ec == ERROR_PIPE_CONNECTED)
+			connected = true;
+		else if (ec == ERROR_IO_PENDING)
+			connected = pipe_wait_overlapped(w, w->pipe, &ov);
+		else
+			FF_LOG_N(w->source_name.c_str(), LOG_WARNING, "ConnectNamedPipe: %lu", ec);
+	}
+	CloseHandle(ov.hEvent);
+	return connected;
+}
+
+static bool pipe_write(pipe_writer *w, const char *buf, size_t len)
+{
+	OVERLAPPED ov{};
+	ov.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	bool ok = true;
+	while (ok && len > 0) {
+		DWORD numWritten = 0;
+		if (WriteFile(w->pipe, buf, static_cast<DWORD>(len), nullptr, &ov) == FALSE) {
+			auto ec = GetLastError();
+			if (ec != ERROR_IO_PENDING) {
+				if (ec != ERROR_BROKEN_PIPE && ec != ERROR_NO_DATA)
+					FF_LOG_N(w->source_name.c_str(), LOG_WARNING, "WriteFile: %lu", ec);
+				ok = false;
+				break;
+			}
+			if (!pipe_wait_overlapped(w, w->pipe, &ov)) {
+				ok = false;
+				break;
+			}
+		}
+		if (GetOverlappedResult(w->pipe, &ov, &numWritten, FALSE) == FALSE) {
+			ok = false;
+			break;
+		}
+		ResetEvent(ov.hEvent);
+		buf += numWritten;
+		len -= numWritten;
+	}
+	CloseHandle(ov.hEvent);
+	return ok;
+}
+
+static void pipe_close(pipe_writer *w, bool connected, const std::string &path)
+{
+	UNUSED_PARAMETER(connected);
+	UNUSED_PARAMETER(path);
+	std::lock_guard lock{w->pipe_mutex};
+	if (w->pipe != INVALID_HANDLE_VALUE) {
+		CloseHandle(w->pipe);
+		w->pipe = INVALID_HANDLE_VALUE;
+	}
+}
+
+// Drops the reader's end from another thread, so FFmpeg sees EOF even if the write thread is stuck.
+static void pipe_abandon(pipe_writer *w)
+{
+	std::lock_guard lock{w->pipe_mutex};
+	if (w->pipe != INVALID_HANDLE_VALUE) {
+		CancelIoEx(w->pipe, nullptr);
+		DisconnectNamedPipe(w->pipe);
+	}
+}
+#else
+// Created up front rather than by the write thread, so it exists by the time FFmpeg goes looking for it.
+static bool pipe_create(pipe_writer *w, const std::string &path)
+{
+	if (mkfifo(path.c_str(), S_IRUSR | S_IWUSR) != 0 && errno != EEXIST) {
+		FF_LOG_N(w->source_name.c_str(), LOG_WARNING, "mkfifo: %d", errno);
+		return false;
+	}
+	return true;
+}
+
+static bool pipe_connect(pipe_writer *w, const std::string &path)
+{
+	// a nonblocking open fails with ENXIO until the reader shows up, which lets us keep an eye on the stop signal
+	while (!pipe_unwanted(w)) {
+		int fd = open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+		if (fd >= 0) {
+			std::lock_guard lock{w->pipe_mutex};
+			w->pipe = fd;
+			return true;
+		}
+		if (errno != ENXIO) {
+			FF_LOG_N(w->source_name.c_str(), LOG_WARNING, "open fifo: %d", errno);
+			return false;
+		}
+		os_event_timedwait(w->stop_signal, w->interval_ms);
+	}
+	return false;
+}
+
+static bool pipe_write(pipe_writer *w, const char *buf, size_t len)
+{
+	while (len > 0) {
+		if (pipe_unwanted(w))
+			return false;
+
+		pollfd pfd{w->pipe, POLLOUT, 0};
+		const int ready = poll(&pfd, 1, static_cast<int>(w->interval_ms));
+		if (ready < 0 && errno != EINTR) {
+			FF_LOG_N(w->source_name.c_str(), LOG_WARNING, "poll fifo: %d", errno);
+			return false;
+		}
+		if (ready <= 0)
+			continue;
+
+		const auto numWritten = write(w->pipe, buf, len);
+		if (numWritten < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			if (errno != EPIPE)
+				FF_LOG_N(w->source_name.c_str(), LOG_WARNING, "write fifo: %d", errno);
+			return false;
+		}
+		buf += numWritten;
+		len -= static_cast<size_t>(numWritten);
+	}
+	return true;
+}
+
+static void pipe_close(pipe_writer *w, bool connected, const std::string &path)
+{
+	std::lock_guard lock{w->pipe_mutex};
+	if (w->pipe >= 0) {
+		close(w->pipe);
+		w->pipe = -1;
+	}
+	else if (!connected) {
+		// FFmpeg may be sitting in a blocking open() of the fifo, briefly become its writer to let it through to EOF
+		int fd = open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+		if (fd >= 0)
+			close(fd);
+	}
+}
+
+// Drops the reader's end from another thread, so FFmpeg sees EOF even if the write thread is stuck.
+// The descriptor is swapped for /dev/null instead of closed, so its number can't be reused under the thread.
+static void pipe_abandon(pipe_writer *w)
+{
+	std::lock_guard lock{w->pipe_mutex};
+	if (w->pipe < 0)
+		return;
+	int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (null_fd >= 0) {
+		dup2(null_fd, w->pipe);
+		close(null_fd);
+	}
+}
+#endif
+
+static void pipe_remove(const std::string &path)
+{
+	std::error_code ec;
+	std::filesystem::remove(path, ec);
+	(void)ec;
+}
+
+// Where forwarded data goes, the pipe itself or the timeshift in front of it.
+static bool pipe_output(pipe_writer *w, const char *buf, size_t len)
+{
+	if (!w->shift)
+		return pipe_write(w, buf, len);
+	timeshift_append(w->shift.get(), buf, len);
+	return true;
+}
+
+static void close_stream_quietly(const std::shared_ptr<streamlink::Stream> &stream)
+{
+	streamlink::ThreadGIL state = streamlink::ThreadGIL();
+	try {
+		stream->Close();
+	}
+	catch (std::exception &) {
+	}
+}
+
+static bool pipe_drops(const pipe_writer *w, mpegts::StreamKind kind)
+{
+	return (w->filter.mode == media_mode::audio_only && kind == mpegts::StreamKind::Video) ||
+	       (w->filter.mode == media_mode::video_only && kind == mpegts::StreamKind::Audio);
+}
+
+// Whether a packet survives `keyframes_only`, which decides once per video PES. Has to see every packet of the
+// input in order, and the answer for a keyframe has to be taken before treating it as one.
+static bool pipe_select(const pipe_writer *w, keyframe_state &state, const mpegts::PacketInfo *info)
+{
+	if (!w->filter.keyframes_only || !info || info->kind != mpegts::StreamKind::Video)
+		return true;
+	if (!info->unitStart)
+		return state.keeping;
+	state.keeping = info->randomAccess;
+	if (state.keeping && info->hasPts && state.kept_any) {
+		// a PTS going backwards wraps around to a large distance, which starts over
+		const uint64_t distance = (info->pts - state.last_pts) & mpegts::PtsMask;
+		state.keeping = distance >= static_cast<uint64_t>(w->filter.keyframe_interval_ms) * 90;
+	}
+	if (state.keeping && info->hasPts) {
+		state.last_pts = info->pts;
+		state.kept_any = true;
+	}
+	return state.keeping;
+}
+
+// Appends a packet unless the media mode drops its stream. PMTs are rewritten to match, so that FFmpeg doesn't wait
+// for streams which never come.
+static void pipe_append(const pipe_writer *w, std::vector<char> &out, const uint8_t *data, size_t size,
+			const mpegts::PacketInfo *info)
+{
+	if (info && pipe_drops(w, info->kind))
+		return;
+	const size_t start = out.size();
+	out.insert(out.end(), data, data + size);
+	if (info && info->isPmt && w->filter.mode != media_mode::audio_video) {
+		const auto dropped = w->filter.mode == media_mode::audio_only ? mpegts::StreamKind::Video : mpegts::StreamKind::Audio;
+		mpegts::DropFromPmt(reinterpret_cast<uint8_t*>(&out[start]), dropped);
+	}
+}
+
+// Appends the latest PAT/PMT, for a decoder starting at a keyframe.
+static void pipe_append_psi(const pipe_writer *w, std::vector<char> &out, const mpegts::Inspector &inspector)
+{
+	out.insert(out.end(), inspector.LastPat().begin(), inspector.LastPat().end());
+	if (inspector.LastPmt().empty())
+		return;
+	mpegts::PacketInfo pmt{};
+	pmt.isPmt = true;
+	pmt.kind = mpegts::StreamKind::Other;
+	pipe_append(w, out, inspector.LastPmt().data(), inspector.LastPmt().size(), &pmt);
+}
+
+// Appends the start of the packet the inspector holds back, so that the next chunk can go out as read. Filtered
+// output is only ever made of whole packets.
+static void pipe_append_tail(pipe_writer *w, std::vector<char> &out)
+{
+	w->tail_out = w->filter.passes_everything();
+	if (w->tail_out)
+		out.insert(out.end(), w->inspector.Pending().begin(), w->inspector.Pending().end());
+}
+
+// Hands `chunk` to the recorder, the replay buffer and the HTTP clients. With `cut`, it starts another stream, which
+// the recorder begins a new segment for and the replay buffer a new GOP.
+static void pipe_tee(pipe_writer *w, const std::shared_ptr<const std::vector<char>> &chunk, bool cut = false)
+{
+	std::shared_ptr<recorder> r;
+	std::shared_ptr<replay_buffer> rb;
+	std::shared_ptr<http_server> hs;
+	{
+		std::lock_guard lock{w->tee_mutex};
+		r = w->tee;
+		rb = w->replay;
+		hs = w->serve;
+	}
+	if (r) {
+		if (cut)
+			recorder_cut(r.get());
+		recorder_push(r.get(), chunk);
+	}
+	if (rb) {
+		if (cut)
+			replay_buffer_cut(rb.get());
+		replay_buffer_push(rb.get(), *chunk);
+	}
+	if (hs)
+		http_server_push(hs.get(), chunk);
+}
+
+static bool pipe_splice(pipe_writer *w)
+{
+	std::shared_ptr<splice_candidate> c;
+	{
+		std::lock_guard lock{w->splice_mutex};
+		c = std::move(w->candidate);
+		w->splice_ready = false;
+	}
+	if (!c)
+		return true;
+
+	std::lock_guard candidate_lock{c->mutex};
+	c->taken = true;
+	// media-playback picked its streams when it opened the input, new PIDs would just be ignored
+	if (c->inspector.Streams() != w->inspector.Streams()) {
+		FF_LOG_N(w->source_name.c_str(), LOG_INFO, "new definition has a different program layout, reopening instead");
+		close_stream_quietly(c->stream);
+		w->restart_requested = true;
+		return true;
+	}
+
+	auto old_stream = c->stream;
+	{
+		std::lock_guard lock{w->stream_mutex};
+		std::swap(w->stream, old_stream);
+	}
+	w->inspector = std::move(c->inspector);
+	w->keyframes = c->keyframes;
+	// the new stream starts with the session's ring buffer size
+	w->buffer_applied = 0;
+	close_stream_quietly(old_stream);
+	FF_LOG_N(w->source_name.c_str(), LOG_INFO, "definition switched seamlessly");
+	// the tees get the new stream from the same keyframe on, and the start of the packet its next chunk continues
+	auto teed = std::make_shared<std::vector<char>>(w->filter.passes_everything() ? c->staged : c->staged_unfiltered);
+	teed->insert(teed->end(), w->inspector.Pending().begin(), w->inspector.Pending().end());
+	pipe_tee(w, teed, true);
+	// what the new stream reads next continues the packet it was in the middle of
+	pipe_append_tail(w, c->staged);
+	return pipe_output(w, c->staged.data(), c->staged.size());
+}
+
+// Passes what was read from streamlink on to the pipe, and splices in a pending definition switch at a keyframe,
+// which is where HLS segments start.
+static bool pipe_forward(pipe_writer *w, const std::vector<char> &buf)
+{
+	const bool splicing = w->splice_ready;
+	if (!splicing && w->filter.passes_everything() && (w->tail_out || w->inspector.Pending().empty())) {
+		// still inspected, so the program layout is known by the time a switch comes in
+		w->inspector.Feed(buf.data(), buf.size(), [](const uint8_t *, size_t, const mpegts::PacketInfo *) {});
+		w->tail_out = true;
+		return pipe_output(w, buf.data(), buf.size());
+	}
+
+	std::vector<char> out{};
+	out.reserve(buf.size());
+	bool splice = false;
+	// the start of the first packet went out with the previous chunk already
+	size_t written = w->tail_out ? w->inspector.Pending().size() : 0;
+	w->inspector.Feed(buf.data(), buf.size(), [&](const uint8_t *data, size_t size, const mpegts::PacketInfo *info) {
+		if (splice)
+			return; // the rest of the old stream is dropped
+		if (written > 0) {
+			// finished even when it is the keyframe to splice at, a torn packet would garble the next one
+			out.insert(out.end(), data + written, data + size);
+			written = 0;
+			splice = splicing && info && info->randomAccess;
+			return;
+		}
+		if (splicing && info && info->randomAccess) {
+			splice = true;
+			return;
+		}
+		if (pipe_select(w, w->keyframes, info))
+			pipe_append(w, out, data, size, info);
+	});
+	if (splicing && !splice && (!w->inspector.IsTs() || os_gettime_ns() - w->splice_ready_ts > SPLICE_DEADLINE_NS))
+		splice = true;
+	// the old stream only goes on when there is no splice after all, its next chunk then comes as whole packets
+	if (splice)
+		w->tail_out = false;
+	else
+		pipe_append_tail(w, out);
+	if (!out.empty() && !pipe_output(w, out.data(), out.size()))
+		return false;
+	return !splice || pipe_splice(w);
+}
+
+// While warm, keeps the latest PAT/PMT and every packet since the latest keyframe, so that decoding can start
+// right away once shown. A GOP over the limit is dropped, the decoder then waits for the next keyframe as usual.
+static void pipe_keep_warm(pipe_writer *w, const std::vector<char> &buf)
+{
+	// only whole packets are kept, the one the pipe got the start of is left unfinished along with the pipe
+	w->tail_out = false;
+	w->inspector.Feed(buf.data(), buf.size(), [&](const uint8_t *data, size_t size, const mpegts::PacketInfo *info) {
+		if (!info || !pipe_select(w, w->keyframes, info))
+			return;
+		if (info->randomAccess) {
+			w->warm_buffer.clear();
+			pipe_append_psi(w, w->warm_buffer, w->inspector);
+			w->warm_keyframe = true;
+		}
+		if (!w->warm_keyframe)
+			return;
+		if (w->warm_buffer.size() + size > w->warm_limit) {
+			w->warm_buffer.clear();
+			w->warm_keyframe = false;
+			return;
+		}
+		pipe_append(w, w->warm_buffer, data, size, info);
+	});
+	w->warm_bytes = w->warm_buffer.capacity();
+	w->warm_peak = std::max(w->warm_peak.load(), w->warm_bytes.load());
+}
+
+static bool pipe_flush_warm(pipe_writer *w)
+{
+	bool ok = true;
+	if (w->warm_keyframe) {
+		FF_LOG_N(w->source_name.c_str(), LOG_INFO, "resuming from warm standby with %zu KiB since the latest keyframe (peak %zu KiB)",
+			 w->warm_buffer.size() / 1024, w->warm_peak.load() / 1024);
+		pipe_append_tail(w, w->warm_buffer);
+		ok = pipe_output(w, w->warm_buffer.data(), w->warm_buffer.size());
+	}
+	w->warm_buffer = std::vector<char>{};
+	w->warm_keyframe = false;
+	w->warm_bytes = 0;
+	return ok;
+}
+
+// Holds everything back until the first keyframe, then starts with the latest PAT/PMT and that keyframe, so that
+// FFmpeg doesn't probe and discard a partial GOP first. Returns false once done, the data is then forwarded as usual.
+static bool pipe_gate(pipe_writer *w, const std::vector<char> &buf, bool &ok)
+{
+	std::vector<char> out{};
+	std::vector<char> all{};
+	bool keyframe = false;
+	w->inspector.Feed(buf.data(), buf.size(), [&](const uint8_t *data, size_t size, const mpegts::PacketInfo *info) {
+		if (!pipe_select(w, w->keyframes, info))
+			return;
+		pipe_append(w, all, data, size, info);
+		if (info && info->randomAccess) {
+			// only the latest keyframe in what was read is kept
+			out.clear();
+			pipe_append_psi(w, out, w->inspector);
+			keyframe = true;
+		}
+		if (keyframe || !info)
+			pipe_append(w, out, data, size, info);
+	});
+
+	const bool no_video = !w->inspector.Streams().empty() && w->inspector.VideoPid() == mpegts::NullPid;
+	const bool expired = os_gettime_ns() - w->gate_ts > GATE_DEADLINE_NS;
+	if (!keyframe && !w->inspector.IsNotTs() && !no_video && !expired)
+		return true;
+
+	if (keyframe)
+		FF_LOG_N(w->source_name.c_str(), LOG_INFO, "starting at a keyframe after %.0f ms",
+			 static_cast<double>(os_gettime_ns() - w->gate_ts) / 1000000.0);
+	if (!keyframe && !w->inspector.IsNotTs())
+		out = std::move(all); // no keyframe to wait for, or it took too long
+	// the next chunk is forwarded as read, starting with the rest of the packet held back
+	pipe_append_tail(w, out);
+	ok = pipe_output(w, out.data(), out.size());
+	return false;
+}
+
+struct splice_request {
+	std::shared_ptr<pipe_writer> writer;
+	std::shared_ptr<streamlink::Session> session;
+	std::string url{};
+	std::string definition{};
+	unsigned long generation{};
+};
+
+static void *splice_thread(void *data)
+{
+	os_set_thread_name("splice_thread");
+
+	const auto req = std::unique_ptr<splice_request>(static_cast<splice_request*>(data));
+	const auto &w = req->writer;
+	const auto superseded = [&] { return w->stopping() || w->splice_generation != req->generation; };
+
+	auto c = std::make_shared<splice_candidate>();
+	{
+		streamlink::ThreadGIL state = streamlink::ThreadGIL();
+		try {
+			auto streams = req->session->GetStreamsFromUrl(req->url);
+			auto pref = streams.find(req->definition);
+			if (pref == streams.end())
+				throw std::runtime_error{"definition not available"};
+			c->stream = std::make_shared<streamlink::Stream>(pref->second.Open());
+		}
+		catch (std::exception & ex) {
+			FF_LOG_N(w->source_name.c_str(), LOG_WARNING, "Failed to open definition \"%s\" for switching: %s", req->definition.c_str(), ex.what());
+			if (!superseded())
+				w->restart_requested = true;
+			return nullptr;
+		}
+	}
+
+	const double read_timeout = static_cast<double>(w->interval_ms) / 1000.0;
+	bool keyframe = false;
+	bool published = false;
+	while (!superseded()) {
+		std::lock_guard lock{c->mutex};
+		if (c->taken)
+			return nullptr; // the write thread reads it from now on
+
+		std::vector<char> read_buf{};
+		try {
+			streamlink::ThreadGIL state = streamlink::ThreadGIL();
+			read_buf = c->stream->Read(READ_SIZE, read_timeout);
+		}
+		catch (streamlink::read_timeout &) {
+			continue;
+		}
+		catch (std::exception & ex) {
+			FF_LOG_N(w->source_name.c_str(), LOG_WARNING, "read (switching): %s", ex.what());
+			break;
+		}
+		if (read_buf.empty())
+			break;
+
+		const bool filtered = !w->filter.passes_everything();
+		c->inspector.Feed(read_buf.data(), read_buf.size(), [&](const uint8_t *data, size_t size, const mpegts::PacketInfo *info) {
+			if (!info)
+				return;
+			const bool selected = pipe_select(w.get(), c->keyframes, info);
+			if (selected && info->randomAccess) {
+				c->staged.clear();
+				pipe_append_psi(w.get(), c->staged, c->inspector);
+				if (filtered) {
+					c->staged_unfiltered.assign(c->inspector.LastPat().begin(), c->inspector.LastPat().end());
+					c->staged_unfiltered.insert(c->staged_unfiltered.end(), c->inspector.LastPmt().begin(),
+								    c->inspector.LastPmt().end());
+				}
+				keyframe = true;
+			}
+			if (!keyframe)
+				return;
+			if (selected)
+				pipe_append(w.get(), c->staged, data, size, info);
+			if (filtered)
+				c->staged_unfiltered.insert(c->staged_unfiltered.end(), data, data + size);
+		});
+		if (c->inspector.IsNotTs() || c->staged.size() > MAX_SPLICE_STAGED ||
+		    c->staged_unfiltered.size() > MAX_SPLICE_STAGED)
+			break;
+
+		if (keyframe && !published) {
+			std::lock_guard splice_lock{w->splice_mutex};
+			w->candidate = c;
+			w->splice_ready_ts = os_gettime_ns();
+			w->splice_ready = true;
+			published = true;
+		}
+	}
+
+	{
+		std::lock_guard splice_lock{w->splice_mutex};
+		if (w->candidate == c) {
+			w->candidate.reset();
+			w->splice_ready = false;
+		}
+	}
+	std::lock_guard lock{c->mutex};
+	if (!c->taken) {
+		close_stream_quietly(c->stream);
+		if (!superseded())
+			w->restart_requested = true;
+	}
+	return nullptr;
+}
+
+// Called with the GIL held.
+static void pipe_index_vod(pipe_writer *w)
+{
+	auto segments = w->stream->VodSegmentDurations();
+	if (!segments.empty())
+		FF_LOG_N(w->source_name.c_str(), LOG_INFO, "VOD playlist with %zu segments", segments.size());
+	std::lock_guard lock{w->vod_mutex};
+	w->vod_segments = std::move(segments);
+	w->vod_indexed = true;
+}
+
+// Called with the GIL held.
+static void pipe_resize_buffer(pipe_writer *w)
+{
+	const size_t target = w->buffer_target;
+	if (target == 0 || target == w->buffer_applied)
+		return;
+	w->buffer_applied = target;
+	if (w->stream->ResizeBuffer(target))
+		FF_LOG_N(w->source_name.c_str(), LOG_INFO, "ring buffer resized to %zu KiB", target / 1024);
+}
+
+// After every read which returned data.
+static void pipe_observe_data(pipe_writer *w)
+{
+	w->starved_ts = 0;
+	w->stall_counted = false;
+}
+
+// A read timed out, the ring buffer is empty.
+static void pipe_observe_starved(pipe_writer *w)
+{
+	const uint64_t now = os_gettime_ns();
+	if (w->starved_ts == 0) {
+		w->starved_ts = now;
+		return;
+	}
+	if (w->stall_counted || now - w->starved_ts < STALL_NS)
+		return;
+	w->stall_counted = true;
+	w->stalls++;
+	FF_LOG_N(w->source_name.c_str(), LOG_INFO, "stalled, nothing arrived for %.1f s",
+		 static_cast<double>(now - w->starved_ts) / 1000000000.0);
+}
+
+static void pipe_throttle(pipe_writer *w, size_t bytes)
+{
+	std::shared_ptr<bandwidth_limit> bl;
+	{
+		std::lock_guard lock{w->tee_mutex};
+		bl = w->limit;
+	}
+	if (bl)
+		bandwidth_limit_take(bl.get(), bytes, [w] { return w->stopping(); });
+}
+
+static void block_sigpipe()
+{
+#ifndef _WIN32
+	// a reader going away must surface as EPIPE from write(), not as a process-wide SIGPIPE
+	sigset_t sigpipe;
+	sigemptyset(&sigpipe);
+	sigaddset(&sigpipe, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &sigpipe, nullptr);
+#endif
+}
+
+// Takes up the seek `pipe_writer_seek` asked for, once the feeder let go of the previous pipe. False without one.
+static bool timeshift_apply_seek(pipe_writer *w)
+{
+	std::lock_guard lock{w->seek_mutex};
+	if (w->seek != seek_state::waiting)
+		return false;
+	if (!pipe_create(w, w->seek_path)) {
+		w->seek = seek_state::failed;
+		return false;
+	}
+	{
+		std::lock_guard pipe_lock{w->pipe_mutex};
+		w->pipe_path = w->seek_path;
+	}
+	if (w->seek_position_ms < 0)
+		timeshift_live(w->shift.get());
+	else
+		timeshift_seek(w->shift.get(), w->seek_position_ms);
+	w->shift_release = false;
+	w->shift_idle = false;
+	w->seek = seek_state::ready;
+	return true;
+}
+
+// Moves what the timeshift holds into the pipe, from wherever its cursor is. Lets go of the pipe when its reader
+// goes away or a seek asks for it, and waits for the next pipe, see `pipe_writer_seek`.
+static void *timeshift_feed_thread(void *data)
+{
+	os_set_thread_name("timeshift_feed_thread");
+	// the write thread holds the reference, and joins this thread before letting go of it
+	const auto w = static_cast<pipe_writer*>(data);
+	block_sigpipe();
+
+	std::vector<char> buf{};
+	while (!w->stopping()) {
+		if (w->shift_idle) {
+			if (timeshift_apply_seek(w))
+				continue;
+			if (w->shift_done)
+				break;
+			os_event_timedwait(w->shift_wake, w->interval_ms);
+			continue;
+		}
+		const std::string path = pipe_current_path(w);
+		const bool connected = pipe_connect(w, path);
+		bool drained = false;
+		while (connected && !pipe_unwanted(w)) {
+			timeshift_take(w->shift.get(), buf, READ_SIZE, w->interval_ms);
+			if (buf.empty()) {
+				drained = timeshift_drained(w->shift.get());
+				if (drained)
+					break;
+				continue;
+			}
+			if (!pipe_write(w, buf.data(), buf.size()))
+				break;
+		}
+		pipe_close(w, connected, path);
+		pipe_remove(path);
+		w->shift_idle = true;
+		if (drained)
+			break;
+	}
+	std::lock_guard lock{w->seek_mutex};
+	if (w->seek == seek_state::waiting)
+		w->seek = seek_state::failed;
+	return nullptr;
+}
+
+static void *write_pipe_thread(void *data) {
+	os_set_thread_name("write_thread");
+
+	// hold our own reference, `streamlink_source` may let go of the writer at any time
+	const auto w = std::move(*static_cast<std::shared_ptr<pipe_writer>*>(data));
+	delete static_cast<std::shared_ptr<pipe_writer>*>(data);
+	block_sigpipe();
+
+	const bool shifting = w->shift && pthread_create(&w->shift_thread, nullptr, timeshift_feed_thread, w.get()) == 0;
+	if (w->shift && !shifting)
+		FF_LOG_N(w->source_name.c_str(), LOG_WARNING, "failed to start the timeshift feeder");
+
+	const double read_timeout = static_cast<double>(w->interval_ms) / 1000.0;
+	std::string path = pipe_current_path(w.get());
+	// the feeder takes care of the pipe when shifting
+	bool connected = shifting;
+	w->gate_ts = os_gettime_ns();
+	while (!w->stopping() && shifting == static_cast<bool>(w->shift)) {
+		if (w->warm && !w->pipe_idle) {
+			// let the reader see EOF, so media-playback can be freed
+			pipe_close(w.get(), connected, path);
+			pipe_remove(path);
+			connected = false;
+			w->pipe_idle = true;
+		}
+		if (!w->warm && !w->relay && !connected) {
+			path = pipe_current_path(w.get());
+			if (!pipe_connect(w.get(), path)) {
+				if (w->stopping() || !w->warm)
+					break;
+				continue;
+			}
+			connected = true;
+			FF_LOG_N(w->source_name.c_str(), LOG_INFO, "ready to read and write");
+			// kept data already starts at a keyframe
+			if (w->warm_keyframe)
+				w->gated = false;
+			if (!pipe_flush_warm(w.get()) && !w->warm)
+				break;
+			w->gate_ts = os_gettime_ns();
+		}
+
+		std::vector<char> read_buf{};
+		try {
+			streamlink::ThreadGIL state = streamlink::ThreadGIL();
+			read_buf = w->stream->Read(READ_SIZE, read_timeout);
+			// the playlist is loaded by the time any of it arrives
+			if (!w->vod_indexed && !read_buf.empty())
+				pipe_index_vod(w.get());
+			pipe_resize_buffer(w.get());
+			if (!read_buf.empty())
+				pipe_observe_data(w.get());
+		}
+		catch (streamlink::read_timeout &) {
+			// only once data came in, opening takes as long as it takes
+			if (w->vod_indexed)
+				pipe_observe_starved(w.get());
+			continue;
+		}
+		catch (std::exception & ex) {
+			if (!w->stopping())
+				FF_LOG_N(w->source_name.c_str(), LOG_WARNING, "read: %s", ex.what());
+			break;
+		}
+
+		if (read_buf.empty()) {
+			FF_LOG_N(w->source_name.c_str(), LOG_INFO, "read: EOF");
+			break;
+		}
+		pipe_throttle(w.get(), read_buf.size());
+		// the recorder gets the very same buffer
+		const auto chunk = std::make_shared<const std::vector<char>>(std::move(read_buf));
+		pipe_tee(w.get(), chunk);
+
+		if (w->relay)
+			continue;
+		if (w->warm) {
+			pipe_keep_warm(w.get(), *chunk);
+			continue;
+		}
+		if (w->gated) {
+			bool ok = true;
+			w->gated = pipe_gate(w.get(), *chunk, ok);
+			if (!ok && !w->warm)
+				break;
+			continue;
+		}
+		if (!pipe_forward(w.get(), *chunk) && !w->warm)
+			break;
+		// FF_BLOG(LOG_INFO, "numWritten=%lld", numWritten);
+	}
+	if (shifting) {
+		// whatever is left in the timeshift still plays
+		timeshift_end(w->shift.get());
+		w->shift_done = true;
+		os_event_signal(w->shift_wake);
+		pthread_join(w->shift_thread, nullptr);
+	}
+	else if (!w->pipe_idle) {
+		pipe_close(w.get(), connected, path);
+		pipe_remove(path);
+	}
+
+	os_event_signal(w->exited_signal);
+	return nullptr;
+}
+
+static bool pipe_writer_launch(const std::shared_ptr<pipe_writer> &w)
+{
+	auto thread_data = new std::shared_ptr<pipe_writer>(w);
+	if (pthread_create(&w->thread, nullptr, write_pipe_thread, thread_data) != 0) {
+		delete thread_data;
+		return false;
+	}
+	return true;
+}
+
+static std::shared_ptr<pipe_writer> pipe_writer_new(std::shared_ptr<streamlink::Stream> stream, const char *source_name,
+						    unsigned long interval_ms)
+{
+	auto w = std::make_shared<pipe_writer>();
+	w->stream = std::move(stream);
+	w->source_name = source_name;
+	w->interval_ms = interval_ms;
+
+	if (os_event_init(&w->stop_signal, OS_EVENT_TYPE_MANUAL) != 0 ||
+	    os_event_init(&w->exited_signal, OS_EVENT_TYPE_MANUAL) != 0 ||
+	    os_event_init(&w->shift_wake, OS_EVENT_TYPE_AUTO) != 0)
+		return nullptr;
+	return w;
+}
+
+std::shared_ptr<pipe_writer> pipe_writer_start(std::shared_ptr<streamlink::Stream> stream, const std::string &pipe_path,
+					       const char *source_name, unsigned long interval_ms, const pipe_filter &filter,
+					       bool start_at_keyframe, std::unique_ptr<timeshift> shift)
+{
+	auto w = pipe_writer_new(std::move(stream), source_name, interval_ms);
+	if (!w)
+		return nullptr;
+	w->pipe_path = pipe_path;
+	w->filter = filter;
+	w->shift = std::move(shift);
+	// audio doesn't wait for a video keyframe
+	w->gated = start_at_keyframe && filter.mode != media_mode::audio_only;
+	if (!pipe_create(w.get(), pipe_path))
+		return nullptr;
+
+	if (!pipe_writer_launch(w)) {
+		pipe_close(w.get(), true, pipe_path);
+		pipe_remove(pipe_path);
+		return nullptr;
+	}
+	return w;
+}
+
+std::shared_ptr<pipe_writer> pipe_writer_start_warm(std::shared_ptr<streamlink::Stream> stream, const char *source_name,
+						    unsigned long interval_ms, const pipe_filter &filter, size_t limit)
+{
+	auto w = pipe_writer_new(std::move(stream), source_name, interval_ms);
+	if (!w)
+		return nullptr;
+	w->filter = filter;
+	w->warm_limit = limit;
+	w->warm = true;
+	w->pipe_idle = true;
+	w->gated = filter.mode != media_mode::audio_only;
+
+	if (!pipe_writer_launch(w))
+		return nullptr;
+	return w;
+}
+
+std::shared_ptr<pipe_writer> pipe_writer_start_relay(std::shared_ptr<streamlink::Stream> stream, const char *source_name,
+						     unsigned long interval_ms)
+{
+	auto w = pipe_writer_new(std::move(stream), source_name, interval_ms);
+	if (!w)
+		return nullptr;
+	w->relay = true;
+	w->pipe_idle = true;
+
+	if (!pipe_writer_launch(w))
+		return nullptr;
+	return w;
+}
+
+// Joins the writers left behind by `pipe_writer_stop` which are done by now, or all of them when `wait`.
+static void pipe_writer_reap(bool wait)
+{
+	std::lock_guard lock{abandoned_mutex};
+	for (auto it = abandoned.begin(); it != abandoned.end();) {
+		const auto &w = *it;
+		if (!wait && os_event_try(w->exited_signal) == EAGAIN) {
+			++it;
+			continue;
+		}
+		os_event_wait(w->exited_signal);
+		pthread_join(w->thread, nullptr);
+		it = abandoned.erase(it);
+	}
+}
+
+void pipe_writer_stop(const std::shared_ptr<pipe_writer> &w, unsigned long timeout_ms)
+{
+	os_event_signal(w->stop_signal);
+	{
+		// wake up a read blocked inside streamlink, the read deadline does not cover every stream type
+		std::shared_ptr<streamlink::Stream> stream;
+		{
+			std::lock_guard lock{w->stream_mutex};
+			stream = w->stream;
+		}
+		streamlink::ThreadGIL state = streamlink::ThreadGIL();
+		try {
+			stream->Close();
+		}
+		catch (std::exception & ex) {
+			FF_LOG_N(w->source_name.c_str(), LOG_DEBUG, "Error interrupting streamlink stream: %s", ex.what());
+		}
+	}
+
+	if (os_event_timedwait(w->exited_signal, timeout_ms) == 0) {
+		pthread_join(w->thread, nullptr);
+		return;
+	}
+
+	FF_LOG_N(w->source_name.c_str(), LOG_WARNING, "write thread did not stop within %lu ms, leaving it behind", timeout_ms);
+	pipe_abandon(w.get());
+	pipe_writer_reap(false);
+	std::lock_guard lock{abandoned_mutex};
+	abandoned.push_back(w);
+}
+
+void pipe_writer_shutdown()
+{
+	pipe_writer_reap(true);
+}
+
+bool pipe_writer_switch(const std::shared_ptr<pipe_writer> &w, std::shared_ptr<streamlink::Session> session,
+			const std::string &url, const std::string &definition)
+{
+	auto req = new splice_request{w, std::move(session), url, definition, ++w->splice_generation};
+	pthread_t thread;
+	if (pthread_create(&thread, nullptr, splice_thread, req) != 0) {
+		delete req;
+		return false;
+	}
+	pthread_detach(thread);
+	return true;
+}
+
+void pipe_writer_keep_warm(const std::shared_ptr<pipe_writer> &w, size_t limit)
+{
+	w->warm_limit = limit;
+	w->warm_peak = 0;
+	w->warm = true;
+}
+
+void pipe_writer_record(const std::shared_ptr<pipe_writer> &w, std::shared_ptr<recorder> r)
+{
+	if (r)
+		recorder_cut(r.get());
+	std::lock_guard lock{w->tee_mutex};
+	w->tee = std::move(r);
+}
+
+void pipe_writer_replay(const std::shared_ptr<pipe_writer> &w, std::shared_ptr<replay_buffer> rb)
+{
+	if (rb)
+		replay_buffer_cut(rb.get());
+	std::lock_guard lock{w->tee_mutex};
+	w->replay = std::move(rb);
+}
+
+void pipe_writer_serve(const std::shared_ptr<pipe_writer> &w, std::shared_ptr<http_server> hs)
+{
+	std::lock_guard lock{w->tee_mutex};
+	w->serve = std::move(hs);
+}
+
+void pipe_writer_limit(const std::shared_ptr<pipe_writer> &w, std::shared_ptr<bandwidth_limit> bl)
+{
+	std::lock_guard lock{w->tee_mutex};
+	w->limit = std::move(bl);
+}
+
+bool pipe_writer_resume(const std::shared_ptr<pipe_writer> &w, const std::string &pipe_path)
+{
+	// the write thread has to be done with the previous pipe first
+	if (!w->pipe_idle || !pipe_create(w.get(), pipe_path))
+		return false;
+	{
+		std::lock_guard lock{w->pipe_mutex};
+		w->pipe_path = pipe_path;
+	}
+	w->pipe_idle = false;
+	w->warm = false;
+	return true;
+}
+
+bool pipe_writer_seek(const std::shared_ptr<pipe_writer> &w, const std::string &pipe_path, int64_t position_ms)
+{
+	if (!w->shift || w->shift_done)
+		return false;
+	// as for `pipe_writer_resume`, the feeder has to be done with the previous pipe first, it creates the new one
+	// itself once it is, see `timeshift_apply_seek`
+	{
+		std::lock_guard lock{w->seek_mutex};
+		w->seek_path = pipe_path;
+		w->seek_position_ms = position_ms;
+		w->shift_release = true;
+		w->seek = seek_state::waiting;
+	}
+	timeshift_interrupt(w->shift.get());
+	os_event_signal(w->shift_wake);
+	return true;
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+#include "bandwidth-limit.hpp"
+#include "http-server.hpp"
+#include "mpegts.hpp"
+#include "python-streamlink.h"
+#include "recorder.hpp"
+#include "replay-buffer.hpp"
+#include "timeshift.hpp"
+
+#include <util/threading.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct splice_candidate;
+
+// Which of the elementary streams reach the decoder, the others are dropped before FFmpeg ever sees them.
+enum class media_mode : long long { audio_video, audio_only, video_only };
+
+// What the write thread leaves out of MPEG-TS input, so that it isn't decoded for nothing.
+struct pipe_filter {
+	media_mode mode{};
+	// only video PES starting at a keyframe, at most one per `keyframe_interval_ms` of PTS
+	bool keyframes_only{};
+	uint32_t keyframe_interval_ms{};
+
+	bool passes_everything() const
+	{
+		return mode == media_mode::audio_video && !keyframes_only;
+	}
+
+	bool operator==(const pipe_filter &) const = default;
+};
+
+// Where a seek into the timeshift is at, see `pipe_writer_seek`.
+enum class seek_state { none, waiting, ready, failed };
+
+// Where `keyframes_only` is at in one input, see `pipe_select`.
+struct keyframe_state {
+	bool keeping{true};
+	bool kept_any{};
+	uint64_t last_pts{};
+};
+
+// Moves what streamlink reads into the pipe media-playback opens as its input.
+// Everything the write thread touches lives here instead of in `streamlink_source`, so that a thread
+// which does not stop within the stop timeout can be left behind to finish on its own.
+struct pipe_writer {
+	// only replaced by the write thread, under `stream_mutex`
+	std::shared_ptr<streamlink::Stream> stream;
+	std::mutex stream_mutex;
+	mpegts::Inspector inspector;
+	// the start of the packet `inspector` holds back went out already, so the next chunk can follow as read; only
+	// touched by the write thread
+	bool tail_out{};
+
+	std::mutex splice_mutex;
+	std::shared_ptr<splice_candidate> candidate;
+	std::atomic_bool splice_ready{};
+	std::atomic<uint64_t> splice_ready_ts{};
+	std::atomic<unsigned long> splice_generation{};
+	// asks `video_tick` for a full reopen, when a seamless switch was not possible
+	std::atomic_bool restart_requested{};
+
+	// while warm, nothing goes to the pipe, only the data since the latest keyframe is kept
+	std::atomic_bool warm{};
+	std::atomic<size_t> warm_limit{};
+	std::vector<char> warm_buffer{};
+	bool warm_keyframe{};
+	std::atomic<size_t> warm_bytes{};
+	std::atomic<size_t> warm_peak{};
+	// everything read is handed to it as well, whatever happens to it afterwards
+	std::mutex tee_mutex;
+	std::shared_ptr<recorder> tee;
+	std::shared_ptr<replay_buffer> replay;
+	std::shared_ptr<http_server> serve;
+	// reads wait for it before anything is done with them
+	std::shared_ptr<bandwidth_limit> limit;
+	// when set, everything forwarded goes into it instead of the pipe, and a feeder thread of its own moves it on
+	// from wherever playback is at, see `pipe_writer_seek`
+	std::unique_ptr<timeshift> shift;
+	pthread_t shift_thread{};
+	// asks the feeder to let go of its pipe, which it acknowledges with `shift_idle`
+	std::atomic_bool shift_release{};
+	std::atomic_bool shift_idle{};
+	// wakes the feeder while idle, for a seek or once the write thread is done
+	os_event_t *shift_wake{};
+	// the seek the feeder takes up once it let go of its pipe, guards `shift_release` being set along with it
+	std::mutex seek_mutex;
+	std::string seek_path{};
+	int64_t seek_position_ms{};
+	std::atomic<seek_state> seek{seek_state::none};
+	// the write thread is done, the feeder leaves once drained
+	std::atomic_bool shift_done{};
+
+	// segment durations in seconds when the stream turned out to be a VOD, looked up once data arrived
+	std::mutex vod_mutex;
+	std::vector<double> vod_segments{};
+	std::atomic_bool vod_indexed{};
+
+	// the size the stream's ring buffer should have, applied by the write thread between reads; 0 leaves it alone
+	std::atomic<size_t> buffer_target{};
+	size_t buffer_applied{};
+	// for HLS tuning: how often the ring buffer ran dry for longer than a stall since the source last looked
+	std::atomic<unsigned> stalls{};
+	uint64_t starved_ts{};
+	bool stall_counted{};
+
+	// set by the write thread once it let go of the pipe it had before going warm
+	std::atomic_bool pipe_idle{};
+	// nothing is forwarded until a keyframe, see `pipe_gate`; only touched by the write thread once started
+	bool gated{};
+	uint64_t gate_ts{};
+
+	std::string source_name{};
+	unsigned long interval_ms{};
+	// fixed once started, `keyframes` is only touched by the write thread
+	pipe_filter filter{};
+	// never has a pipe, what is read only goes to the tees
+	bool relay{};
+	keyframe_state keyframes{};
+
+	pthread_t thread{};
+	os_event_t *stop_signal{};
+	os_event_t *exited_signal{};
+
+	// guards the path and the handle, both are swapped from other threads
+	std::mutex pipe_mutex;
+	std::string pipe_path{};
+#ifdef _WIN32
+	HANDLE pipe{INVALID_HANDLE_VALUE};
+#else
+	int pipe{-1};
+#endif
+
+	~pipe_writer();
+
+	bool stopping() const
+	{
+		return os_event_try(stop_signal) != EAGAIN;
+	}
+};
+
+// Creates the pipe at `pipe_path` and starts feeding `stream` into it, from its first keyframe if `start_at_keyframe`.
+// Everything goes through `shift` first if given, which the pipe can then be moved around in.
+std::shared_ptr<pipe_writer> pipe_writer_start(std::shared_ptr<streamlink::Stream> stream, const std::string &pipe_path,
+					       const char *source_name, unsigned long interval_ms, const pipe_filter &filter,
+					       bool start_at_keyframe, std::unique_ptr<timeshift> shift);
+// Starts warm without any pipe, for a source which is about to be shown, see `pipe_writer_resume`.
+std::shared_ptr<pipe_writer> pipe_writer_start_warm(std::shared_ptr<streamlink::Stream> stream, const char *source_name,
+						    unsigned long interval_ms, const pipe_filter &filter, size_t limit);
+// Reads `stream` only for the tees, without any pipe or decoder, see `pipe_writer_record` and the like.
+std::shared_ptr<pipe_writer> pipe_writer_start_relay(std::shared_ptr<streamlink::Stream> stream, const char *source_name,
+						     unsigned long interval_ms);
+// Leaves the thread behind if it does not finish within `timeout_ms`, see `pipe_writer_shutdown`.
+void pipe_writer_stop(const std::shared_ptr<pipe_writer> &w, unsigned long timeout_ms);
+// Waits for every writer left behind to finish, before the module goes away.
+void pipe_writer_shutdown();
+
+// Opens `definition` next to the running stream, the write thread splices it in at a keyframe.
+bool pipe_writer_switch(const std::shared_ptr<pipe_writer> &w, std::shared_ptr<streamlink::Session> session,
+			const std::string &url, const std::string &definition);
+
+// Stops feeding the pipe, so its reader can go away, and keeps at most `limit` bytes since the latest keyframe.
+void pipe_writer_keep_warm(const std::shared_ptr<pipe_writer> &w, size_t limit);
+// Tees what is read into `r` from now on, null to stop.
+void pipe_writer_record(const std::shared_ptr<pipe_writer> &w, std::shared_ptr<recorder> r);
+// Keeps the last seconds of what is read in `rb` from now on, null to stop.
+void pipe_writer_replay(const std::shared_ptr<pipe_writer> &w, std::shared_ptr<replay_buffer> rb);
+// Hands what is read to the clients of `hs` from now on, null to stop.
+void pipe_writer_serve(const std::shared_ptr<pipe_writer> &w, std::shared_ptr<http_server> hs);
+// Paces what is read by `bl` from now on, null to read as fast as it comes.
+void pipe_writer_limit(const std::shared_ptr<pipe_writer> &w, std::shared_ptr<bandwidth_limit> bl);
+// Feeds a new pipe at `pipe_path`, starting with what was kept while warm.
+bool pipe_writer_resume(const std::shared_ptr<pipe_writer> &w, const std::string &pipe_path);
+// Asks the feeder to feed a new pipe at `pipe_path` from the keyframe at or before `position_ms` into the timeshift,
+// or from the latest one when negative. The reader of the previous pipe has to be gone already. Returns right away,
+// `seek` turns `ready` once the pipe exists, `failed` if it could not be created. False without a timeshift.
+bool pipe_writer_seek(const std::shared_ptr<pipe_writer> &w, const std::string &pipe_path, int64_t position_ms);
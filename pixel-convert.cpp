@@ -0,0 +1,276 @@
+#include "pixel-convert.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXEL_CONVERT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define PIXEL_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+// dst = min(255, round(src >> shift)) for `count` samples
+using narrow_fn = void (*)(const uint16_t *src, uint8_t *dst, size_t count, int shift);
+// uv = interleave(avg(u0, u1), avg(v0, v1)) for `count` chroma samples per plane
+using average_interleave_fn = void (*)(const uint8_t *u0, const uint8_t *u1, const uint8_t *v0, const uint8_t *v1,
+				       uint8_t *uv, size_t count);
+
+static void narrow_c(const uint16_t *src, uint8_t *dst, size_t count, int shift)
+{
+	const uint32_t round = 1u << (shift - 1);
+	for (size_t i = 0; i < count; i++)
+		dst[i] = static_cast<uint8_t>(std::min<uint32_t>(255, (src[i] + round) >> shift));
+}
+
+static void average_interleave_c(const uint8_t *u0, const uint8_t *u1, const uint8_t *v0, const uint8_t *v1, uint8_t *uv,
+				 size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		uv[2 * i] = static_cast<uint8_t>((u0[i] + u1[i] + 1) >> 1);
+		uv[2 * i + 1] = static_cast<uint8_t>((v0[i] + v1[i] + 1) >> 1);
+	}
+}
+
+#ifdef PIXEL_CONVERT_X86
+static void narrow_sse2(const uint16_t *src, uint8_t *dst, size_t count, int shift)
+{
+	const __m128i round = _mm_set1_epi16(static_cast<short>(1 << (shift - 1)));
+	const __m128i bits = _mm_cvtsi32_si128(shift);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		// saturating add, so that 0xFFFF doesn't wrap around; packus then clamps to 255
+		__m128i a = _mm_adds_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), round);
+		__m128i b = _mm_adds_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 8)), round);
+		a = _mm_srl_epi16(a, bits);
+		b = _mm_srl_epi16(b, bits);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(a, b));
+	}
+	narrow_c(src + i, dst + i, count - i, shift);
+}
+
+static void average_interleave_sse2(const uint8_t *u0, const uint8_t *u1, const uint8_t *v0, const uint8_t *v1,
+				    uint8_t *uv, size_t count)
+{
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const __m128i u = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(u0 + i)),
+					       _mm_loadu_si128(reinterpret_cast<const __m128i *>(u1 + i)));
+		const __m128i v = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(v0 + i)),
+					       _mm_loadu_si128(reinterpret_cast<const __m128i *>(v1 + i)));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(uv + 2 * i), _mm_unpacklo_epi8(u, v));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(uv + 2 * i + 16), _mm_unpackhi_epi8(u, v));
+	}
+	average_interleave_c(u0 + i, u1 + i, v0 + i, v1 + i, uv + 2 * i, count - i);
+}
+
+TARGET_AVX2 static void narrow_avx2(const uint16_t *src, uint8_t *dst, size_t count, int shift)
+{
+	const __m256i round = _mm256_set1_epi16(static_cast<short>(1 << (shift - 1)));
+	const __m128i bits = _mm_cvtsi32_si128(shift);
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		__m256i a = _mm256_adds_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)), round);
+		__m256i b = _mm256_adds_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 16)), round);
+		a = _mm256_srl_epi16(a, bits);
+		b = _mm256_srl_epi16(b, bits);
+		// packus works per 128-bit lane, the permute puts the quarters back in order
+		const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+	}
+	narrow_c(src + i, dst + i, count - i, shift);
+}
+
+TARGET_AVX2 static void average_interleave_avx2(const uint8_t *u0, const uint8_t *u1, const uint8_t *v0,
+						const uint8_t *v1, uint8_t *uv, size_t count)
+{
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		const __m256i u = _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(u0 + i)),
+						  _mm256_loadu_si256(reinterpret_cast<const __m256i *>(u1 + i)));
+		const __m256i v = _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(v0 + i)),
+						  _mm256_loadu_si256(reinterpret_cast<const __m256i *>(v1 + i)));
+		// unpack works per 128-bit lane too
+		const __m256i lo = _mm256_unpacklo_epi8(u, v);
+		const __m256i hi = _mm256_unpackhi_epi8(u, v);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(uv + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(uv + 2 * i + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+	average_interleave_c(u0 + i, u1 + i, v0 + i, v1 + i, uv + 2 * i, count - i);
+}
+
+static bool cpu_has_avx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	// the OS has to save the YMM registers too
+	if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+#ifdef PIXEL_CONVERT_NEON
+static void narrow_neon(const uint16_t *src, uint8_t *dst, size_t count, int shift)
+{
+	const uint16x8_t round = vdupq_n_u16(static_cast<uint16_t>(1 << (shift - 1)));
+	const int16x8_t bits = vdupq_n_s16(static_cast<int16_t>(-shift));
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const uint16x8_t a = vshlq_u16(vqaddq_u16(vld1q_u16(src + i), round), bits);
+		const uint16x8_t b = vshlq_u16(vqaddq_u16(vld1q_u16(src + i + 8), round), bits);
+		vst1q_u8(dst + i, vcombine_u8(vqmovn_u16(a), vqmovn_u16(b)));
+	}
+	narrow_c(src + i, dst + i, count - i, shift);
+}
+
+static void average_interleave_neon(const uint8_t *u0, const uint8_t *u1, const uint8_t *v0, const uint8_t *v1,
+				    uint8_t *uv, size_t count)
+{
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		uint8x16x2_t out;
+		out.val[0] = vrhaddq_u8(vld1q_u8(u0 + i), vld1q_u8(u1 + i));
+		out.val[1] = vrhaddq_u8(vld1q_u8(v0 + i), vld1q_u8(v1 + i));
+		vst2q_u8(uv + 2 * i, out);
+	}
+	average_interleave_c(u0 + i, u1 + i, v0 + i, v1 + i, uv + 2 * i, count - i);
+}
+#endif
+
+struct kernel_set {
+	narrow_fn narrow;
+	average_interleave_fn average_interleave;
+	const char *name;
+};
+
+// the best first
+static const std::vector<kernel_set> available = [] {
+	std::vector<kernel_set> sets{};
+#ifdef PIXEL_CONVERT_X86
+	if (cpu_has_avx2())
+		sets.push_back({narrow_avx2, average_interleave_avx2, "avx2"});
+	sets.push_back({narrow_sse2, average_interleave_sse2, "sse2"});
+#elif defined(PIXEL_CONVERT_NEON)
+	sets.push_back({narrow_neon, average_interleave_neon, "neon"});
+#endif
+	sets.push_back({narrow_c, average_interleave_c, "c"});
+	return sets;
+}();
+
+static const kernel_set &kernels = available.front();
+
+const char *pixel_convert_kernels()
+{
+	return kernels.name;
+}
+
+std::vector<const char *> pixel_convert_kernel_sets()
+{
+	std::vector<const char *> names{};
+	for (const auto &set : available)
+		names.push_back(set.name);
+	return names;
+}
+
+static uint8_t *plane(pixel_converter &conv, int index, uint32_t linesize, uint32_t rows)
+{
+	conv.planes[index].resize(static_cast<size_t>(linesize) * rows);
+	conv.out.data[index] = conv.planes[index].data();
+	conv.out.linesize[index] = linesize;
+	return conv.out.data[index];
+}
+
+static void narrow_plane(const kernel_set &kernels, const obs_source_frame *in, int index, uint8_t *dst,
+			 uint32_t dst_linesize, uint32_t samples, uint32_t rows, int shift)
+{
+	for (uint32_t y = 0; y < rows; y++)
+		kernels.narrow(reinterpret_cast<const uint16_t *>(in->data[index] + static_cast<size_t>(y) * in->linesize[index]),
+			       dst + static_cast<size_t>(y) * dst_linesize, samples, shift);
+}
+
+static const obs_source_frame *convert(const kernel_set &kernels, pixel_converter &conv, const obs_source_frame *in)
+{
+	if (!in || (in->format != VIDEO_FORMAT_P010 && in->format != VIDEO_FORMAT_I010 && in->format != VIDEO_FORMAT_I422))
+		return in;
+
+	const uint32_t width = in->width;
+	const uint32_t height = in->height;
+	const uint32_t chroma_width = (width + 1) / 2;
+	const uint32_t chroma_height = (height + 1) / 2;
+
+	const auto source_format = in->format;
+	// everything but the pixels stays as decoded
+	conv.out = *in;
+	std::fill(std::begin(conv.out.data), std::end(conv.out.data), nullptr);
+	std::fill(std::begin(conv.out.linesize), std::end(conv.out.linesize), 0u);
+
+	switch (source_format) {
+	case VIDEO_FORMAT_P010: {
+		// 10 bits in the top of 16
+		conv.out.format = VIDEO_FORMAT_NV12;
+		narrow_plane(kernels, in, 0, plane(conv, 0, width, height), width, width, height, 8);
+		narrow_plane(kernels, in, 1, plane(conv, 1, chroma_width * 2, chroma_height), chroma_width * 2,
+			     chroma_width * 2, chroma_height, 8);
+		break;
+	}
+	case VIDEO_FORMAT_I010: {
+		// 10 bits in the bottom of 16
+		conv.out.format = VIDEO_FORMAT_I420;
+		narrow_plane(kernels, in, 0, plane(conv, 0, width, height), width, width, height, 2);
+		narrow_plane(kernels, in, 1, plane(conv, 1, chroma_width, chroma_height), chroma_width, chroma_width,
+			     chroma_height, 2);
+		narrow_plane(kernels, in, 2, plane(conv, 2, chroma_width, chroma_height), chroma_width, chroma_width,
+			     chroma_height, 2);
+		break;
+	}
+	default: {
+		conv.out.format = VIDEO_FORMAT_NV12;
+		uint8_t *y_plane = plane(conv, 0, width, height);
+		for (uint32_t y = 0; y < height; y++)
+			memcpy(y_plane + static_cast<size_t>(y) * width, in->data[0] + static_cast<size_t>(y) * in->linesize[0],
+			       width);
+		// 4:2:2 has every chroma row, pairs of them are averaged
+		uint8_t *uv_plane = plane(conv, 1, chroma_width * 2, chroma_height);
+		for (uint32_t y = 0; y < chroma_height; y++) {
+			const uint32_t top = 2 * y;
+			const uint32_t bottom = std::min(top + 1, height - 1);
+			kernels.average_interleave(in->data[1] + static_cast<size_t>(top) * in->linesize[1],
+						   in->data[1] + static_cast<size_t>(bottom) * in->linesize[1],
+						   in->data[2] + static_cast<size_t>(top) * in->linesize[2],
+						   in->data[2] + static_cast<size_t>(bottom) * in->linesize[2],
+						   uv_plane + static_cast<size_t>(y) * chroma_width * 2, chroma_width);
+		}
+		break;
+	}
+	}
+	return &conv.out;
+}
+
+const obs_source_frame *pixel_convert_to_420(pixel_converter &conv, const obs_source_frame *in)
+{
+	return convert(kernels, conv, in);
+}
+
+const obs_source_frame *pixel_convert_to_420_with(pixel_converter &conv, const obs_source_frame *in, const char *name)
+{
+	for (const auto &set : available)
+		if (strcmp(set.name, name) == 0)
+			return convert(set, conv, in);
+	return nullptr;
+}
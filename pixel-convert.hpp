@@ -0,0 +1,25 @@
+#pragma once
+
+#include <obs.h>
+
+#include <cstdint>
+#include <vector>
+
+// Reduces 10-bit and 4:2:2 frames to 8-bit 4:2:0 before OBS copies and uploads them: P010 -> NV12, I010 -> I420 and
+// I422 -> NV12. OBS takes those formats as they are, but at twice the bytes per sample or with twice the chroma, which
+// adds up over many tiles that don't need the precision.
+// The kernels are picked once at runtime: AVX2 or SSE2 on x86, NEON on ARM, plain C elsewhere.
+struct pixel_converter {
+	std::vector<uint8_t> planes[3];
+	obs_source_frame out{};
+};
+
+// Returns `in` itself for any other format. Otherwise a frame owned by `conv`, valid until the next call.
+const obs_source_frame *pixel_convert_to_420(pixel_converter &conv, const obs_source_frame *in);
+// "avx2", "sse2", "neon" or "c", for the log.
+const char *pixel_convert_kernels();
+
+// Every kernel set this CPU can run, the picked one first, for tests/pixel-convert-test.cpp.
+std::vector<const char *> pixel_convert_kernel_sets();
+// `pixel_convert_to_420` with the kernel set called `name` instead of the picked one, null when it can't run here.
+const obs_source_frame *pixel_convert_to_420_with(pixel_converter &conv, const obs_source_frame *in, const char *name);
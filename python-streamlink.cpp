@@ -6,7 +6,12 @@
 
 #include <frameobject.h> // TODO: move to "python-x.h"
 
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
 #include <sstream>
+#include <string_view>
+#include <unordered_map>
 
 namespace streamlink {
     bool loaded = false;
@@ -170,6 +175,73 @@ namespace streamlink {
 
         return {buf1, buf1 + readLen};
     }
+    // `RingBuffer.read` raises a bare `OSError("Read timeout")` when the deadline passes, any other `OSError` is a
+    // real one. Leaves the exception set.
+    bool IsReadTimeout()
+    {
+        if (!PyErr_ExceptionMatches(PyExc_OSError))
+            return false;
+        PyObject* type, * value, * traceback;
+        PyErr_Fetch(&type, &value, &traceback);
+        PyErr_NormalizeException(&type, &value, &traceback);
+        bool timeout = false;
+        if (const auto message = value ? PyObject_Str(value) : nullptr) {
+            timeout = PyStringToString(message) == "Read timeout";
+            Py_DECREF(message);
+        }
+        else PyErr_Clear();
+        PyErr_Restore(type, value, traceback);
+        return timeout;
+    }
+    std::vector<char> Stream::Read(const size_t readSize, const double timeout)
+    {
+        // Streams backed by a streamlink `RingBuffer` expose it as `buffer`, whose `read` takes a deadline.
+        // Anything else (e.g. the FFmpeg muxer pipe) can only be read blocking.
+        const auto buffer = PyObject_GetAttrString(underlying, "buffer");
+        if (!buffer) {
+            PyErr_Clear();
+            return Read(readSize);
+        }
+        auto bufferGuard = PyObjectHolder(buffer, false);
+        const auto readFunc = PyObject_GetAttrString(buffer, "read");
+        if (!readFunc) {
+            PyErr_Clear();
+            return Read(readSize);
+        }
+        auto readFuncGuard = PyObjectHolder(readFunc, false);
+        if (!PyCallable_Check(readFunc)) return Read(readSize);
+
+        // same as `StreamIO.read`: only block while the writer is still producing data
+        bool block = true;
+        if (const auto writer = PyObject_GetAttrString(underlying, "writer")) {
+            auto writerGuard = PyObjectHolder(writer, false);
+            if (const auto alive = PyObject_CallMethod(writer, "is_alive", nullptr)) {
+                block = PyObject_IsTrue(alive) == 1;
+                Py_DECREF(alive);
+            }
+            else PyErr_Clear();
+        }
+        else PyErr_Clear();
+
+        auto args = Py_BuildValue("(nOd)", static_cast<Py_ssize_t>(readSize), block ? Py_True : Py_False, timeout);
+        auto argsGuard = PyObjectHolder(args, false);
+
+        const auto result = PyObject_Call(readFunc, args, nullptr);
+        if (!result) {
+            if (IsReadTimeout()) {
+                PyErr_Clear();
+                throw read_timeout();
+            }
+            throw call_failure(GetExceptionInfo().c_str());
+        }
+        auto resultGuard = PyObjectHolder(result, false);
+
+        char* buf1;
+        ssize_t readLen;
+        PyBytes_AsStringAndSize(result, &buf1, &readLen);
+
+        return {buf1, buf1 + readLen};
+    }
     void Stream::Close()
     {
         auto args = PyTuple_New(0);
@@ -184,6 +256,70 @@ namespace streamlink {
         if (result == nullptr)
             throw call_failure(GetExceptionInfo().c_str());
     }
+    std::vector<double> Stream::VodSegmentDurations()
+    {
+        // HLS readers keep the worker which loads the playlist, its `playlist_end` is only set for playlists with an end
+        std::vector<double> durations;
+        const auto worker = PyObject_GetAttrString(underlying, "worker");
+        if (!worker) {
+            PyErr_Clear();
+            return durations;
+        }
+        auto workerGuard = PyObjectHolder(worker, false);
+        const auto end = PyObject_GetAttrString(worker, "playlist_end");
+        if (!end) {
+            PyErr_Clear();
+            return durations;
+        }
+        auto endGuard = PyObjectHolder(end, false);
+        if (end == Py_None)
+            return durations;
+        const auto segments = PyObject_GetAttrString(worker, "playlist_segments");
+        if (!segments) {
+            PyErr_Clear();
+            return durations;
+        }
+        auto segmentsGuard = PyObjectHolder(segments, false);
+        const auto list = PySequence_Fast(segments, "playlist_segments is not a sequence");
+        if (!list) {
+            PyErr_Clear();
+            return durations;
+        }
+        auto listGuard = PyObjectHolder(list, false);
+
+        const auto size = PySequence_Fast_GET_SIZE(list);
+        for (Py_ssize_t i = 0; i < size; i++) {
+            const auto duration = PyObject_GetAttrString(PySequence_Fast_GET_ITEM(list, i), "duration");
+            if (!duration) {
+                PyErr_Clear();
+                return {};
+            }
+            auto durationGuard = PyObjectHolder(duration, false);
+            const double seconds = PyFloat_AsDouble(duration);
+            if (PyErr_Occurred()) {
+                PyErr_Clear();
+                return {};
+            }
+            durations.push_back(seconds);
+        }
+        return durations;
+    }
+    bool Stream::ResizeBuffer(const size_t bytes)
+    {
+        const auto buffer = PyObject_GetAttrString(underlying, "buffer");
+        if (!buffer) {
+            PyErr_Clear();
+            return false;
+        }
+        auto bufferGuard = PyObjectHolder(buffer, false);
+        const auto result = PyObject_CallMethod(buffer, "resize", "n", static_cast<Py_ssize_t>(bytes));
+        if (!result) {
+            PyErr_Clear();
+            return false;
+        }
+        Py_DECREF(result);
+        return true;
+    }
     StreamInfo::StreamInfo(std::string name, PyObject* u) : PyObjectHolder(u), name(std::move(name))
     {
 
@@ -208,6 +344,85 @@ namespace streamlink {
         return result;
     }
 
+    PyObject* StreamInfo::Open(const double startOffset)
+    {
+        if (startOffset <= 0)
+            return Open();
+        // read by the HLS worker when the stream is opened, put back afterwards as the stream may be opened again
+        const auto previous = PyObject_GetAttrString(underlying, "start_offset");
+        if (!previous) {
+            PyErr_Clear();
+            return Open();
+        }
+        auto previousGuard = PyObjectHolder(previous, false);
+        auto offset = PyFloat_FromDouble(startOffset);
+        auto offsetGuard = PyObjectHolder(offset, false);
+        if (PyObject_SetAttrString(underlying, "start_offset", offset) != 0)
+            throw call_failure(GetExceptionInfo().c_str());
+        PyObject* result = nullptr;
+        try {
+            result = Open();
+        }
+        catch (...) {
+            PyObject_SetAttrString(underlying, "start_offset", previous);
+            throw;
+        }
+        PyObject_SetAttrString(underlying, "start_offset", previous);
+        return result;
+    }
+
+    std::string StreamInfo::ToJson()
+    {
+        auto jsonModule = PyImport_ImportModule("json");
+        if (!jsonModule) throw call_failure(GetExceptionInfo().c_str());
+        auto jsonModuleGuard = PyObjectHolder(jsonModule, false);
+
+        auto description = PyObject_CallMethod(underlying, "__json__", nullptr);
+        if (!description) throw call_failure(GetExceptionInfo().c_str());
+        auto descriptionGuard = PyObjectHolder(description, false);
+
+        auto result = PyObject_CallMethod(jsonModule, "dumps", "O", description);
+        if (!result) throw call_failure(GetExceptionInfo().c_str());
+        auto resultGuard = PyObjectHolder(result, false);
+        return PyStringToString(result);
+    }
+
+    bool StreamInfo::Recreatable()
+    {
+        auto streamModule = PyImport_ImportModule("streamlink.stream");
+        if (!streamModule) throw call_failure(GetExceptionInfo().c_str());
+        auto streamModuleGuard = PyObjectHolder(streamModule, false);
+        for (const auto className : {"HLSStream", "HTTPStream"}) {
+            auto cls = PyObject_GetAttrString(streamModule, className);
+            if (!cls) throw call_failure(GetExceptionInfo().c_str());
+            auto clsGuard = PyObjectHolder(cls, false);
+            if (reinterpret_cast<PyObject*>(Py_TYPE(underlying)) == cls)
+                return true;
+        }
+        return false;
+    }
+
+    std::string StreamInfo::Type()
+    {
+        auto result = PyObject_CallMethod(underlying, "shortname", nullptr);
+        if (!result) throw call_failure(GetExceptionInfo().c_str());
+        auto resultGuard = PyObjectHolder(result, false);
+        if (!PyUnicode_Check(result)) throw invalid_underlying_object();
+        return PyStringToString(result);
+    }
+
+    std::string StreamInfo::Url()
+    {
+        auto url = PyObject_GetAttrString(underlying, "url");
+        if (!url) {
+            PyErr_Clear();
+            return "";
+        }
+        auto urlGuard = PyObjectHolder(url, false);
+        if (!PyUnicode_Check(url)) return "";
+        return PyStringToString(url);
+    }
+
     ThreadGIL::ThreadGIL()
     {
         state = PyGILState_Ensure();
@@ -284,6 +499,54 @@ namespace streamlink {
     }
 }
 
+namespace streamlink {
+    StreamInfo Session::StreamFromJson(const std::string& name, const std::string& json)
+    {
+        if (!loaded) throw not_loaded();
+        auto jsonModule = PyImport_ImportModule("json");
+        if (!jsonModule) throw call_failure(GetExceptionInfo().c_str());
+        auto jsonModuleGuard = PyObjectHolder(jsonModule, false);
+
+        auto description = PyObject_CallMethod(jsonModule, "loads", "s#", json.c_str(), static_cast<Py_ssize_t>(json.size()));
+        if (!description) throw call_failure(GetExceptionInfo().c_str());
+        auto descriptionGuard = PyObjectHolder(description, false);
+        if (!PyDict_Check(description)) throw call_failure("stream description is not an object");
+
+        auto typeObj = PyDict_GetItemString(description, "type"); // borrowed
+        auto urlObj = PyDict_GetItemString(description, "url"); // borrowed
+        auto headersObj = PyDict_GetItemString(description, "headers"); // borrowed
+        if (!typeObj || !urlObj || !PyUnicode_Check(typeObj)) throw call_failure("stream description lacks type or url");
+
+        const auto type = PyStringToString(typeObj);
+        const char* className;
+        if (type == "hls")
+            className = "HLSStream";
+        else if (type == "http")
+            className = "HTTPStream";
+        else
+            throw call_failure(("unsupported stream type " + type).c_str());
+
+        auto streamModule = PyImport_ImportModule("streamlink.stream");
+        if (!streamModule) throw call_failure(GetExceptionInfo().c_str());
+        auto streamModuleGuard = PyObjectHolder(streamModule, false);
+        auto cls = PyObject_GetAttrString(streamModule, className);
+        if (!cls) throw call_failure(GetExceptionInfo().c_str());
+        auto clsGuard = PyObjectHolder(cls, false);
+
+        auto args = PyTuple_Pack(2, underlying, urlObj);
+        auto argsGuard = PyObjectHolder(args, false);
+        auto kwargs = PyDict_New();
+        auto kwargsGuard = PyObjectHolder(kwargs, false);
+        if (headersObj && PyDict_Check(headersObj))
+            PyDict_SetItemString(kwargs, "headers", headersObj);
+
+        auto result = PyObject_Call(cls, args, kwargs);
+        if (!result) throw call_failure(GetExceptionInfo().c_str());
+        auto resultGuard = PyObjectHolder(result, false);
+        return {name, result};
+    }
+}
+
 void streamlink::Session::SetOption(std::string const& name, PyObject* value)
 {
     if (!loaded) throw not_loaded();
@@ -326,3 +589,171 @@ void streamlink::Session::SetOptionBool(std::string const& name, bool value)
     auto valueObjGuard = PyObjectHolder(valueObj, false);
     SetOption(name, valueObj);
 }
+
+namespace streamlink {
+    // What the response hook of `Session::WatchSegments` keeps, owned by the capsule it is bound to.
+    struct SegmentWatch {
+        std::function<void(double, double)> report;
+        // Python may switch threads within the hook, the map is only touched without calling into it
+        std::mutex mutex;
+        // absolute segment URLs of the playlists loaded so far, with how long they play
+        std::unordered_map<std::string, double> durations;
+    };
+    constexpr auto SegmentWatchName = "obs_streamlink.SegmentWatch";
+    // live playlists keep adding segments, the ones long gone are dropped along with everything else past this
+    constexpr size_t SegmentWatchLimit = 4096;
+
+    static void DeleteSegmentWatch(PyObject* capsule)
+    {
+        delete static_cast<SegmentWatch*>(PyCapsule_GetPointer(capsule, SegmentWatchName));
+    }
+
+    // The `#EXTINF` durations of an HLS media playlist, keyed by the URL of the segment each one is for.
+    static std::vector<std::pair<std::string, double>> ParsePlaylist(PyObject* playlistUrl, std::string_view body)
+    {
+        std::vector<std::pair<std::string, double>> segments;
+        const auto parse = PyImport_ImportModule("urllib.parse");
+        if (!parse) {
+            PyErr_Clear();
+            return segments;
+        }
+        auto parseGuard = PyObjectHolder(parse, false);
+
+        double duration = 0.0;
+        while (!body.empty()) {
+            const auto end = body.find('\n');
+            auto line = body.substr(0, end);
+            body.remove_prefix(end == std::string_view::npos ? body.size() : end + 1);
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            if (line.starts_with("#EXTINF:")) {
+                duration = std::strtod(std::string(line.substr(8)).c_str(), nullptr);
+                continue;
+            }
+            if (line.empty() || line.front() == '#' || duration <= 0.0)
+                continue;
+            // segment URIs are relative to the playlist
+            const auto url = PyObject_CallMethod(parse, "urljoin", "Os#", playlistUrl, line.data(),
+                                                 static_cast<Py_ssize_t>(line.size()));
+            if (!url) {
+                PyErr_Clear();
+                return segments;
+            }
+            auto urlGuard = PyObjectHolder(url, false);
+            segments.emplace_back(PyStringToString(url), duration);
+            duration = 0.0;
+        }
+        return segments;
+    }
+
+    // `requests` response hook: `self` is the capsule of a `SegmentWatch`, `args` holds the response.
+    static PyObject* SegmentResponseHook(PyObject* self, PyObject* args, PyObject* kwargs)
+    {
+        const auto watch = static_cast<SegmentWatch*>(PyCapsule_GetPointer(self, SegmentWatchName));
+        PyObject* response; // borrowed
+        if (!watch || !PyArg_ParseTuple(args, "O", &response))
+            return nullptr;
+        // with `stream=True` whoever asked reads the body later
+        const auto stream = kwargs ? PyDict_GetItemString(kwargs, "stream") : nullptr; // borrowed
+        if (stream && PyObject_IsTrue(stream) == 1)
+            Py_RETURN_NONE;
+
+        // `requests` reads the body right after the hooks anyway, an error here is the one it would raise
+        const auto started = std::chrono::steady_clock::now();
+        const auto content = PyObject_GetAttrString(response, "content");
+        if (!content)
+            return nullptr;
+        auto contentGuard = PyObjectHolder(content, false);
+        const double bodySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+        char* data;
+        Py_ssize_t size;
+        if (!PyBytes_Check(content) || PyBytes_AsStringAndSize(content, &data, &size) != 0) {
+            PyErr_Clear();
+            Py_RETURN_NONE;
+        }
+        const auto url = PyObject_GetAttrString(response, "url");
+        if (!url || !PyUnicode_Check(url)) {
+            PyErr_Clear();
+            Py_XDECREF(url);
+            Py_RETURN_NONE;
+        }
+        auto urlGuard = PyObjectHolder(url, false);
+
+        const std::string_view body{data, static_cast<size_t>(size)};
+        if (body.starts_with("#EXTM3U")) {
+            auto segments = ParsePlaylist(url, body);
+            std::lock_guard lock{watch->mutex};
+            if (watch->durations.size() + segments.size() > SegmentWatchLimit)
+                watch->durations.clear();
+            for (auto& [segmentUrl, duration] : segments)
+                watch->durations[std::move(segmentUrl)] = duration;
+            Py_RETURN_NONE;
+        }
+
+        double duration;
+        {
+            std::lock_guard lock{watch->mutex};
+            const auto found = watch->durations.find(PyStringToString(url));
+            if (found == watch->durations.end())
+                Py_RETURN_NONE;
+            duration = found->second;
+            watch->durations.erase(found);
+        }
+        // an error page says nothing about how fast segments arrive
+        const auto status = PyObject_GetAttrString(response, "status_code");
+        const long code = status ? PyLong_AsLong(status) : 0;
+        Py_XDECREF(status);
+        if (PyErr_Occurred())
+            PyErr_Clear();
+        if (code < 200 || code >= 300)
+            Py_RETURN_NONE;
+        // `elapsed` is from sending the request until the headers arrived
+        const auto elapsed = PyObject_GetAttrString(response, "elapsed");
+        const auto headerSeconds = elapsed ? PyObject_CallMethod(elapsed, "total_seconds", nullptr) : nullptr;
+        Py_XDECREF(elapsed);
+        const double seconds = headerSeconds ? PyFloat_AsDouble(headerSeconds) : -1.0;
+        Py_XDECREF(headerSeconds);
+        if (PyErr_Occurred() || seconds < 0.0) {
+            PyErr_Clear();
+            Py_RETURN_NONE;
+        }
+        watch->report(seconds + bodySeconds, duration);
+        Py_RETURN_NONE;
+    }
+
+    static PyMethodDef SegmentResponseHookDef{
+        "obs_streamlink_segment_hook",
+        reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(SegmentResponseHook)),
+        METH_VARARGS | METH_KEYWORDS,
+        nullptr
+    };
+
+    void Session::WatchSegments(std::function<void(double downloadSeconds, double durationSeconds)> report)
+    {
+        if (!loaded) throw not_loaded();
+        const auto watch = new SegmentWatch{std::move(report)};
+        const auto capsule = PyCapsule_New(watch, SegmentWatchName, DeleteSegmentWatch);
+        if (!capsule) {
+            delete watch;
+            throw call_failure(GetExceptionInfo().c_str());
+        }
+        auto capsuleGuard = PyObjectHolder(capsule, false);
+        const auto hook = PyCFunction_NewEx(&SegmentResponseHookDef, capsule, nullptr);
+        if (!hook) throw call_failure(GetExceptionInfo().c_str());
+        auto hookGuard = PyObjectHolder(hook, false);
+
+        // `Streamlink.http` is a `requests.Session`, which runs the hooks in `hooks["response"]` for every response
+        const auto http = PyObject_GetAttrString(underlying, "http");
+        if (!http) throw call_failure(GetExceptionInfo().c_str());
+        auto httpGuard = PyObjectHolder(http, false);
+        const auto hooks = PyObject_GetAttrString(http, "hooks");
+        if (!hooks) throw call_failure(GetExceptionInfo().c_str());
+        auto hooksGuard = PyObjectHolder(hooks, false);
+        const auto responseHooks = PyMapping_GetItemString(hooks, "response");
+        if (!responseHooks) throw call_failure(GetExceptionInfo().c_str());
+        auto responseHooksGuard = PyObjectHolder(responseHooks, false);
+        if (!PyList_Check(responseHooks) || PyList_Append(responseHooks, hook) != 0)
+            throw call_failure("session has no list of response hooks");
+    }
+}
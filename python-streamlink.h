@@ -15,6 +15,7 @@
 #include <Python.h>
 #endif
 
+#include <functional>
 #include <map>
 #include <stdexcept>
 #include <string>
@@ -73,6 +74,7 @@ namespace streamlink {
         { }
     };
     class invalid_underlying_object : public std::exception {};
+    class read_timeout : public std::exception {};
 
     class Stream : public PyObjectHolder
     {
@@ -83,7 +85,14 @@ namespace streamlink {
         Stream(Stream&& another) noexcept;
 
         std::vector<char> Read(size_t readSize);
+        // Throws `read_timeout` if nothing arrived within `timeout` seconds.
+        std::vector<char> Read(size_t readSize, double timeout);
         void Close();
+        // Segment durations in seconds of the playlist an HLS stream reads, once loaded, when it has an end.
+        // Empty for live playlists and anything but HLS.
+        std::vector<double> VodSegmentDurations();
+        // Bounds the `RingBuffer` the stream is read from to `bytes`. False for streams without one.
+        bool ResizeBuffer(size_t bytes);
 
     };
 
@@ -95,6 +104,17 @@ namespace streamlink {
         StreamInfo(StreamInfo&& another) noexcept;
 
         PyObject* Open();
+        // Opens an HLS stream `startOffset` seconds in, streamlink starts fetching at the segment holding it.
+        PyObject* Open(double startOffset);
+        // The stream's own JSON description, what `Session::StreamFromJson` recreates it from.
+        std::string ToJson();
+        // Whether `Session::StreamFromJson` gives back the same stream: a plain `HLSStream` or `HTTPStream`, not a
+        // plugin's subclass of one, which would lose whatever the plugin does on top.
+        bool Recreatable();
+        // `shortname()` of the stream class, e.g. "hls" or "http".
+        std::string Type();
+        // Empty for streams without a single URL, like muxed ones.
+        std::string Url();
     };
 
     class Session : public PyObjectHolder {
@@ -106,11 +126,19 @@ namespace streamlink {
         ~Session() override;
 
         std::map<std::string, StreamInfo> GetStreamsFromUrl(std::string const& url);
+        // Recreates an HLS or HTTP stream from `StreamInfo::ToJson`, without asking the plugin again.
+        StreamInfo StreamFromJson(std::string const& name, std::string const& json);
 
         void SetOption(std::string const& name, PyObject* value);
         void SetOptionString(std::string const& name, std::string const& value);
         void SetOptionDouble(std::string const& name, double value);
         void SetOptionInt(std::string const& name, long long value);
         void SetOptionBool(std::string const& name, bool value);
+
+        // Calls `report` for every HLS segment the session downloads, with how long it took to arrive and how long it
+        // plays, in seconds. Hooks the session's `requests` responses and takes the durations from the `#EXTINF` tags
+        // of the playlists it loaded. `report` runs on streamlink's fetch threads with the GIL held. Segments fetched
+        // with `hls-segment-stream-data` are read after the hook and can't be timed.
+        void WatchSegments(std::function<void(double downloadSeconds, double durationSeconds)> report);
     };
 }
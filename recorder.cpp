@@ -0,0 +1,199 @@
+#include "recorder.hpp"
+
+#include "utils.hpp"
+
+#include <util/platform.h>
+
+#include <algorithm>
+#include <ctime>
+#include <string_view>
+#include <utility>
+
+static std::mutex running_mutex;
+static std::condition_variable running_cv;
+static unsigned running = 0;
+
+static std::string segment_path(recorder *r)
+{
+	char stamp[32];
+	const time_t now = time(nullptr);
+	tm local{};
+#ifdef _WIN32
+	localtime_s(&local, &now);
+#else
+	localtime_r(&now, &local);
+#endif
+	strftime(stamp, sizeof(stamp), "%Y-%m-%d_%H-%M-%S", &local);
+
+	std::string name = r->name;
+	constexpr std::string_view reserved{"/\\:*?\"<>|"};
+	std::replace_if(name.begin(), name.end(), [&](char c) { return reserved.find(c) != std::string_view::npos; }, '_');
+	const std::string prefix = r->directory + "/" + name + "_" + stamp + "_";
+	// another recorder of the same source may have started within the same second
+	std::string path;
+	do
+		path = prefix + std::to_string(++r->segment_index) + ".ts";
+	while (os_file_exists(path.c_str()));
+	return path;
+}
+
+static void recorder_close_segment(recorder *r)
+{
+	if (!r->file)
+		return;
+	fclose(r->file);
+	r->file = nullptr;
+}
+
+static void recorder_open_segment(recorder *r)
+{
+	recorder_close_segment(r);
+	const auto path = segment_path(r);
+	r->file = os_fopen(path.c_str(), "wb");
+	if (!r->file)
+		FF_LOG_N(r->name.c_str(), LOG_WARNING, "recording: failed to open \"%s\"", path.c_str());
+	r->segment_ts = os_gettime_ns();
+}
+
+static void recorder_flush(recorder *r, std::vector<char> &out)
+{
+	if (r->file && !out.empty()) {
+		if (fwrite(out.data(), 1, out.size(), r->file) != out.size()) {
+			FF_LOG_N(r->name.c_str(), LOG_WARNING, "recording: write failed, starting a new segment");
+			recorder_close_segment(r);
+		}
+		else {
+			r->bytes_written += out.size();
+		}
+	}
+	out.clear();
+}
+
+// Segments start at a keyframe with the latest PAT/PMT, so that each plays on its own. Audio only programs can be cut
+// at any PES, and what isn't MPEG-TS at any chunk.
+static void recorder_write(recorder *r, const std::vector<char> &chunk, bool cut)
+{
+	if (cut) {
+		recorder_close_segment(r);
+		r->inspector = mpegts::Inspector{};
+	}
+	std::vector<char> out{};
+	out.reserve(chunk.size());
+	r->inspector.Feed(chunk.data(), chunk.size(), [&](const uint8_t *data, size_t size, const mpegts::PacketInfo *info) {
+		const bool no_video = !r->inspector.Streams().empty() && r->inspector.VideoPid() == mpegts::NullPid;
+		const bool boundary = !info || info->randomAccess || (no_video && info->unitStart && info->kind == mpegts::StreamKind::Audio);
+		if (boundary && (!r->file || (r->segment_ns && os_gettime_ns() - r->segment_ts >= r->segment_ns))) {
+			recorder_flush(r, out);
+			recorder_open_segment(r);
+			if (info) {
+				out.insert(out.end(), r->inspector.LastPat().begin(), r->inspector.LastPat().end());
+				out.insert(out.end(), r->inspector.LastPmt().begin(), r->inspector.LastPmt().end());
+			}
+		}
+		if (r->file)
+			out.insert(out.end(), data, data + size);
+	});
+	recorder_flush(r, out);
+}
+
+static void *recorder_thread(void *data)
+{
+	os_set_thread_name("recorder_thread");
+
+	const auto r = std::move(*static_cast<std::shared_ptr<recorder>*>(data));
+	delete static_cast<std::shared_ptr<recorder>*>(data);
+
+	std::unique_lock lock{r->mutex};
+	while (true) {
+		r->cv.wait(lock, [&] { return r->stopping || !r->queue.empty(); });
+		if (r->queue.empty())
+			break;
+		const auto chunk = std::move(r->queue.front());
+		r->queue.pop_front();
+		r->queued_bytes -= chunk.data->size();
+		r->queue_bytes = r->queued_bytes;
+
+		lock.unlock();
+		recorder_write(r.get(), *chunk.data, chunk.cut);
+		lock.lock();
+	}
+	lock.unlock();
+	recorder_close_segment(r.get());
+	FF_LOG_N(r->name.c_str(), LOG_INFO, "recording stopped, %llu MiB written, %llu MiB dropped",
+		 static_cast<unsigned long long>(r->bytes_written / (1024 * 1024)),
+		 static_cast<unsigned long long>(r->bytes_dropped / (1024 * 1024)));
+
+	std::lock_guard running_lock{running_mutex};
+	running--;
+	running_cv.notify_all();
+	return nullptr;
+}
+
+std::shared_ptr<recorder> recorder_start(const std::string &directory, const char *name, uint32_t segment_s,
+					 size_t queue_limit)
+{
+	if (os_mkdirs(directory.c_str()) == MKDIR_ERROR) {
+		FF_LOG_N(name, LOG_WARNING, "recording: failed to create \"%s\"", directory.c_str());
+		return nullptr;
+	}
+	auto r = std::make_shared<recorder>();
+	r->directory = directory;
+	r->name = name;
+	r->segment_ns = static_cast<uint64_t>(segment_s) * 1000000000ULL;
+	r->queue_limit = queue_limit;
+
+	{
+		std::lock_guard running_lock{running_mutex};
+		running++;
+	}
+	auto thread_data = new std::shared_ptr<recorder>(r);
+	pthread_t thread;
+	if (pthread_create(&thread, nullptr, recorder_thread, thread_data) != 0) {
+		delete thread_data;
+		std::lock_guard running_lock{running_mutex};
+		running--;
+		return nullptr;
+	}
+	pthread_detach(thread);
+	if (segment_s)
+		FF_LOG_N(name, LOG_INFO, "recording into \"%s\", %u s segments", directory.c_str(), segment_s);
+	else
+		FF_LOG_N(name, LOG_INFO, "recording into \"%s\"", directory.c_str());
+	return r;
+}
+
+void recorder_stop(const std::shared_ptr<recorder> &r)
+{
+	std::lock_guard lock{r->mutex};
+	r->stopping = true;
+	r->cv.notify_one();
+}
+
+void recorder_push(recorder *r, std::shared_ptr<const std::vector<char>> chunk)
+{
+	std::lock_guard lock{r->mutex};
+	if (r->stopping)
+		return;
+	if (r->queued_bytes + chunk->size() > r->queue_limit) {
+		// the disk can't keep up, what makes it to the disk has a gap here
+		r->bytes_dropped += chunk->size();
+		r->pending_cut = true;
+		return;
+	}
+	r->queued_bytes += chunk->size();
+	r->queue_bytes = r->queued_bytes;
+	r->queue.push_back({std::move(chunk), std::exchange(r->pending_cut, false)});
+	r->cv.notify_one();
+}
+
+void recorder_cut(recorder *r)
+{
+	std::lock_guard lock{r->mutex};
+	r->pending_cut = true;
+}
+
+void recorder_shutdown()
+{
+	std::unique_lock lock{running_mutex};
+	running_cv.wait(lock, [] { return running == 0; });
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "mpegts.hpp"
+
+#include <util/threading.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct recorder_chunk {
+	std::shared_ptr<const std::vector<char>> data;
+	// the segment being written ends before this chunk
+	bool cut;
+};
+
+// Archives what a source reads, as is, into segments cut at keyframes. The write thread only hands over a reference
+// to each chunk it read; the disk is written from a thread of its own, which drops chunks when it falls behind
+// instead of ever holding up playback.
+struct recorder {
+	std::string directory{};
+	std::string name{};
+	uint64_t segment_ns{};
+	size_t queue_limit{};
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<recorder_chunk> queue{};
+	size_t queued_bytes{};
+	bool stopping{};
+	// the next chunk queued starts a new segment, after a gap or when the input changed
+	bool pending_cut{true};
+
+	// only touched by the recorder thread
+	mpegts::Inspector inspector;
+	FILE *file{};
+	uint64_t segment_ts{};
+	unsigned segment_index{};
+
+	std::atomic<uint64_t> bytes_written{};
+	std::atomic<uint64_t> bytes_dropped{};
+	std::atomic<size_t> queue_bytes{};
+};
+
+// Starts recording into `directory`, segments named after `name`, all in one when `segment_s` is 0. Null if the
+// thread could not be started.
+std::shared_ptr<recorder> recorder_start(const std::string &directory, const char *name, uint32_t segment_s,
+					 size_t queue_limit);
+// Lets the thread write what is still queued and leave on its own, see `recorder_shutdown`.
+void recorder_stop(const std::shared_ptr<recorder> &r);
+// Never blocks on the disk; drops the chunk when more than the queue limit is waiting.
+void recorder_push(recorder *r, std::shared_ptr<const std::vector<char>> chunk);
+// The input continues with another stream, the current segment ends here.
+void recorder_cut(recorder *r);
+
+// Waits for every stopped recorder to finish writing, before the module goes away.
+void recorder_shutdown();
@@ -0,0 +1,114 @@
+#include "replay-buffer.hpp"
+
+#include "recorder.hpp"
+
+// audio only programs are cut about this often
+constexpr uint64_t AUDIO_GOP_PTS = 90000;
+
+static uint64_t pts_distance(uint64_t from, uint64_t to)
+{
+	return (to - from) & mpegts::PtsMask;
+}
+
+std::shared_ptr<replay_buffer> replay_buffer_create(size_t limit, uint32_t window_s)
+{
+	auto rb = std::make_shared<replay_buffer>();
+	rb->limit = limit;
+	rb->window_pts = static_cast<uint64_t>(window_s) * 90000;
+	return rb;
+}
+
+static void replay_buffer_close_gop(replay_buffer *rb)
+{
+	if (!rb->current)
+		return;
+	rb->current->shrink_to_fit();
+	rb->gops.push_back({std::shared_ptr<const std::vector<char>>(std::move(rb->current)), rb->current_pts});
+	rb->bytes += rb->gops.back().data->size();
+}
+
+static void replay_buffer_evict(replay_buffer *rb)
+{
+	const size_t current = rb->current ? rb->current->size() : 0;
+	while (!rb->gops.empty() && rb->bytes + current > rb->limit) {
+		rb->bytes -= rb->gops.front().data->size();
+		rb->gops.pop_front();
+	}
+	if (current > rb->limit)
+		rb->current.reset(); // a GOP this large can't be kept whole, wait for the next one
+	while (rb->gops.size() > 1 && pts_distance(rb->gops[1].pts, rb->latest_pts) >= rb->window_pts) {
+		rb->bytes -= rb->gops.front().data->size();
+		rb->gops.pop_front();
+	}
+	rb->bytes_held = rb->bytes + (rb->current ? rb->current->size() : 0);
+}
+
+void replay_buffer_push(replay_buffer *rb, const std::vector<char> &chunk)
+{
+	std::lock_guard lock{rb->mutex};
+	rb->inspector.Feed(chunk.data(), chunk.size(), [rb](const uint8_t *data, size_t size, const mpegts::PacketInfo *info) {
+		if (!info)
+			return;
+		if (info->hasPts)
+			rb->latest_pts = info->pts;
+		const bool no_video = !rb->inspector.Streams().empty() && rb->inspector.VideoPid() == mpegts::NullPid;
+		bool boundary = info->randomAccess;
+		if (no_video && info->kind == mpegts::StreamKind::Audio && info->hasPts)
+			boundary = !rb->current || pts_distance(rb->current_pts, info->pts) >= AUDIO_GOP_PTS;
+		if (boundary) {
+			replay_buffer_close_gop(rb);
+			rb->current = std::make_unique<std::vector<char>>();
+			rb->current->insert(rb->current->end(), rb->inspector.LastPat().begin(), rb->inspector.LastPat().end());
+			rb->current->insert(rb->current->end(), rb->inspector.LastPmt().begin(), rb->inspector.LastPmt().end());
+			rb->current_pts = rb->latest_pts;
+		}
+		if (rb->current)
+			rb->current->insert(rb->current->end(), data, data + size);
+	});
+	replay_buffer_evict(rb);
+}
+
+void replay_buffer_cut(replay_buffer *rb)
+{
+	std::lock_guard lock{rb->mutex};
+	rb->current.reset();
+	rb->inspector = mpegts::Inspector{};
+	rb->bytes_held = rb->bytes;
+}
+
+int64_t replay_buffer_save(replay_buffer *rb, const std::string &directory, const char *name, uint32_t seconds)
+{
+	std::vector<std::shared_ptr<const std::vector<char>>> clip{};
+	size_t clip_bytes = 0;
+	uint64_t first_pts = 0;
+	uint64_t latest_pts = 0;
+	{
+		std::lock_guard lock{rb->mutex};
+		if (rb->current) {
+			clip.push_back(std::make_shared<const std::vector<char>>(*rb->current));
+			first_pts = rb->current_pts;
+		}
+		// newest first, up to the GOP which starts at or before the requested length
+		const uint64_t target = static_cast<uint64_t>(seconds) * 90000;
+		for (auto it = rb->gops.rbegin(); it != rb->gops.rend(); ++it) {
+			if (!clip.empty() && pts_distance(first_pts, rb->latest_pts) >= target)
+				break;
+			clip.push_back(it->data);
+			first_pts = it->pts;
+		}
+		latest_pts = rb->latest_pts;
+	}
+	if (clip.empty())
+		return 0;
+	for (const auto &gop : clip)
+		clip_bytes += gop->size();
+
+	// written like a recording which is all one segment, in the background
+	auto r = recorder_start(directory, (std::string(name) + " replay").c_str(), 0, clip_bytes);
+	if (!r)
+		return 0;
+	for (auto it = clip.rbegin(); it != clip.rend(); ++it)
+		recorder_push(r.get(), *it);
+	recorder_stop(r);
+	return static_cast<int64_t>(pts_distance(first_pts, latest_pts) / 90);
+}
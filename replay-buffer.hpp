@@ -0,0 +1,45 @@
+#pragma once
+
+#include "mpegts.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One keyframe and everything up to the next, preceded by the PAT/PMT of its time, so that any run of them plays.
+struct replay_gop {
+	std::shared_ptr<const std::vector<char>> data;
+	uint64_t pts;
+};
+
+// The last seconds of what a source reads, kept as is so that they can be saved as a clip without recording
+// everything. Bounded by `window_pts` and by `limit` bytes, whole GOPs at a time.
+struct replay_buffer {
+	size_t limit{};
+	uint64_t window_pts{};
+
+	std::mutex mutex;
+	std::deque<replay_gop> gops{};
+	size_t bytes{};
+	// the GOP still coming in, null until the first keyframe or after it outgrew the limit
+	std::unique_ptr<std::vector<char>> current;
+	uint64_t current_pts{};
+	mpegts::Inspector inspector;
+	uint64_t latest_pts{};
+
+	std::atomic<size_t> bytes_held{};
+};
+
+std::shared_ptr<replay_buffer> replay_buffer_create(size_t limit, uint32_t window_s);
+// Called by the write thread with every chunk it reads. Only MPEG-TS is kept, anything else can't be cut.
+void replay_buffer_push(replay_buffer *rb, const std::vector<char> &chunk);
+// The input continues with another stream, what was kept so far stays but the GOP in progress is dropped.
+void replay_buffer_cut(replay_buffer *rb);
+
+// Writes GOPs covering at least the last `seconds`, or all there is, into a new file in `directory` from a
+// background thread. Returns how many milliseconds it covers, 0 when there was nothing to save.
+int64_t replay_buffer_save(replay_buffer *rb, const std::string &directory, const char *name, uint32_t seconds);
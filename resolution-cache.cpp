@@ -0,0 +1,137 @@
+#include "resolution-cache.hpp"
+
+#include "nlohmann/json.hpp"
+
+#include "utils.hpp"
+
+#include <obs-module.h>
+#include <util/platform.h>
+
+extern "C" {
+#include <libavutil/mem.h>
+#include <libavutil/sha.h>
+}
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+constexpr auto CACHE_FILE = "resolution-cache.json";
+
+static std::mutex cache_mutex;
+static std::optional<nlohmann::json> cache;
+
+// SHA-256 of the key in hex, which is all that ends up in the file. Keys hold proxy URLs and custom options,
+// credentials among them.
+static std::string cache_hash(const std::string &key)
+{
+	uint8_t digest[32]{};
+	AVSHA *sha = av_sha_alloc();
+	if (!sha || av_sha_init(sha, 256) != 0) {
+		av_free(sha);
+		return "";
+	}
+	av_sha_update(sha, reinterpret_cast<const uint8_t*>(key.data()), key.size());
+	av_sha_final(sha, digest);
+	av_free(sha);
+
+	std::string hex{};
+	char byte[3];
+	for (const uint8_t b : digest) {
+		snprintf(byte, sizeof(byte), "%02x", b);
+		hex += byte;
+	}
+	return hex;
+}
+
+static int64_t now_s()
+{
+	return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static nlohmann::json &cache_load()
+{
+	if (cache)
+		return *cache;
+	cache = nlohmann::json::object();
+
+	char *path = obs_module_config_path(CACHE_FILE);
+	char *text = path ? os_quick_read_utf8_file(path) : nullptr;
+	if (text) {
+		try {
+			auto loaded = nlohmann::json::parse(text);
+			if (loaded.is_object())
+				cache = std::move(loaded);
+			// written before keys were hashed, with whatever they held in plain text
+			for (auto it = cache->begin(); it != cache->end();) {
+				if (it.key().size() != 64)
+					it = cache->erase(it);
+				else
+					++it;
+			}
+		}
+		catch (nlohmann::json::exception &ex) {
+			FF_LOG(LOG_WARNING, "Ignoring broken resolution cache: %s", ex.what());
+		}
+	}
+	bfree(text);
+	bfree(path);
+	return *cache;
+}
+
+static void cache_save()
+{
+	// expired entries are only dropped here, nothing reads them anyway
+	const auto now = now_s();
+	for (auto it = cache->begin(); it != cache->end();) {
+		if (!it->is_object() || it->value("expires", int64_t{0}) <= now)
+			it = cache->erase(it);
+		else
+			++it;
+	}
+
+	char *dir = obs_module_config_path("");
+	if (dir) {
+		os_mkdirs(dir);
+		bfree(dir);
+	}
+	char *path = obs_module_config_path(CACHE_FILE);
+	if (!path)
+		return;
+	const auto text = cache->dump();
+	if (!os_quick_write_utf8_file_safe(path, text.c_str(), text.size(), false, "tmp", nullptr))
+		FF_LOG(LOG_WARNING, "Failed to write resolution cache to %s", path);
+	bfree(path);
+}
+
+std::optional<resolution_cache_entry> resolution_cache_get(const std::string &key)
+{
+	std::lock_guard lock{cache_mutex};
+	const auto &entries = cache_load();
+	const auto it = entries.find(cache_hash(key));
+	if (it == entries.end() || !it->is_object() || it->value("expires", int64_t{0}) <= now_s())
+		return std::nullopt;
+	try {
+		return it->at("streams").get<resolution_cache_entry>();
+	}
+	catch (nlohmann::json::exception &) {
+		return std::nullopt;
+	}
+}
+
+void resolution_cache_put(const std::string &key, const resolution_cache_entry &streams, int64_t ttl_s)
+{
+	std::lock_guard lock{cache_mutex};
+	const auto hash = cache_hash(key);
+	if (hash.empty())
+		return;
+	cache_load()[hash] = {{"expires", now_s() + ttl_s}, {"streams", streams}};
+	cache_save();
+}
+
+void resolution_cache_drop(const std::string &key)
+{
+	std::lock_guard lock{cache_mutex};
+	if (cache_load().erase(cache_hash(key)) > 0)
+		cache_save();
+}
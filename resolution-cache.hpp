@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+
+// Stream descriptions from `GetStreamsFromUrl`, persisted in the module config directory so they survive restarts.
+// Keyed by whatever decides which streams a URL resolves to, see `streamlink_source_cache_key`, which is only stored
+// hashed. Streams sending credentials along are never handed to it.
+using resolution_cache_entry = std::map<std::string, std::string>; // definition -> `StreamInfo::ToJson`
+
+// Empty when missing or expired.
+std::optional<resolution_cache_entry> resolution_cache_get(const std::string &key);
+void resolution_cache_put(const std::string &key, const resolution_cache_entry &streams, int64_t ttl_s);
+// For entries whose streams failed to open, most likely because their URLs expired early.
+void resolution_cache_drop(const std::string &key);
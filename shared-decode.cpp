@@ -0,0 +1,83 @@
+#include "shared-decode.hpp"
+
+#include <algorithm>
+#include <map>
+
+static std::mutex registry_mutex;
+static std::map<std::string, std::weak_ptr<shared_decode>> registry;
+
+std::shared_ptr<shared_decode> shared_decode_own(const std::string &key)
+{
+	std::lock_guard lock{registry_mutex};
+	auto &slot = registry[key];
+	if (const auto current = slot.lock(); current && !current->ended)
+		return nullptr;
+	auto d = std::make_shared<shared_decode>(key);
+	slot = d;
+	return d;
+}
+
+void shared_decode_end(const std::shared_ptr<shared_decode> &d, bool handover)
+{
+	{
+		std::lock_guard lock{registry_mutex};
+		const auto it = registry.find(d->key);
+		if (it != registry.end() && it->second.lock() == d)
+			registry.erase(it);
+	}
+	std::lock_guard lock{d->mutex};
+	if (d->ended)
+		return; // the first reason given sticks
+	d->handover = handover;
+	d->ended = true;
+	// the subscribers stop showing the last frame until they have their own
+	for (const auto source : d->subscribers)
+		obs_source_output_video(source, nullptr);
+}
+
+std::shared_ptr<shared_decode> shared_decode_join(const std::string &key, obs_source_t *source)
+{
+	std::shared_ptr<shared_decode> d;
+	{
+		std::lock_guard lock{registry_mutex};
+		const auto it = registry.find(key);
+		if (it == registry.end())
+			return nullptr;
+		d = it->second.lock();
+	}
+	if (!d || d->ended)
+		return nullptr;
+	std::lock_guard lock{d->mutex};
+	d->subscribers.push_back(source);
+	return d;
+}
+
+void shared_decode_leave(const std::shared_ptr<shared_decode> &d, obs_source_t *source)
+{
+	{
+		std::lock_guard lock{d->mutex};
+		d->subscribers.erase(std::remove(d->subscribers.begin(), d->subscribers.end(), source), d->subscribers.end());
+	}
+	obs_source_output_video(source, nullptr);
+}
+
+std::vector<obs_source_t *> shared_decode_subscribers(const std::shared_ptr<shared_decode> &d)
+{
+	std::lock_guard lock{d->mutex};
+	return d->subscribers;
+}
+
+// Under the lock, so that a subscriber which left is never handed anything once `shared_decode_leave` returned.
+void shared_decode_output_video(const std::shared_ptr<shared_decode> &d, const obs_source_frame *frame)
+{
+	std::lock_guard lock{d->mutex};
+	for (const auto source : d->subscribers)
+		obs_source_output_video(source, frame);
+}
+
+void shared_decode_output_audio(const std::shared_ptr<shared_decode> &d, const obs_source_audio *audio)
+{
+	std::lock_guard lock{d->mutex};
+	for (const auto source : d->subscribers)
+		obs_source_output_audio(source, audio);
+}
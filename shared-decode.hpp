@@ -0,0 +1,39 @@
+#pragma once
+
+#include <obs.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Lets streamlink sources which would open the same stream and treat its frames the same way share one fetch and
+// one decoder. The first of them to open owns the decoder and hands every frame and audio packet on to the others.
+struct shared_decode {
+	const std::string key;
+	std::mutex mutex;
+	std::vector<obs_source_t *> subscribers;
+	// set when the owner stopped decoding; `handover` if it only went away and the stream is still good, the
+	// subscribers then open it themselves, one of them becoming the next owner
+	std::atomic_bool ended{};
+	std::atomic_bool handover{};
+
+	explicit shared_decode(std::string key) : key(std::move(key)) {}
+};
+
+// Registers the caller as the owner of `key`, null when some other source already is.
+std::shared_ptr<shared_decode> shared_decode_own(const std::string &key);
+// Called by the owner once it stops decoding, only the first call counts.
+void shared_decode_end(const std::shared_ptr<shared_decode> &d, bool handover);
+
+// Subscribes `source` to the owner of `key`, null when there is none.
+std::shared_ptr<shared_decode> shared_decode_join(const std::string &key, obs_source_t *source);
+void shared_decode_leave(const std::shared_ptr<shared_decode> &d, obs_source_t *source);
+
+// Sources to hand what the owner decodes to, copied.
+std::vector<obs_source_t *> shared_decode_subscribers(const std::shared_ptr<shared_decode> &d);
+
+// Called from the owner's media thread, next to its own output.
+void shared_decode_output_video(const std::shared_ptr<shared_decode> &d, const obs_source_frame *frame);
+void shared_decode_output_audio(const std::shared_ptr<shared_decode> &d, const obs_source_audio *audio);
@@ -4,30 +4,49 @@
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
-#else
-#include <sys/stat.h>
-#include <sys/types.h>
 #endif
 
 #include "nlohmann/json.hpp"
 
+#include "bandwidth-limit.hpp"
+#include "buffer-budget.hpp"
+#include "frame-scaler.hpp"
+#include "pipe-writer.hpp"
+#include "pixel-convert.hpp"
 #include "python-streamlink.h" // TODO: remove
+#include "resolution-cache.hpp"
+#include "shared-decode.hpp"
+#include "worker-pool.hpp"
 
 extern "C" {
 #include <media-playback/media.h>
+#include <util/platform.h>
 }
 
 #include "utils.hpp"
 
-#include <fstream>
-#include <filesystem>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <ctime>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <sstream>
+#include <utility>
 
 #include <obs-module.h>
 
 constexpr auto URL = "url";
 constexpr auto DEFINITIONS = "definitions";
 constexpr auto REFRESH_DEFINITIONS = "refresh_definitions";
+// picks whichever definition fits where the source is shown, see `pick_fitting_definition`
+constexpr auto DEFINITION_AUTO_FIT = "auto (fit)";
+constexpr auto DEFINITION_AUTO_FIT_TEXT = "definition_auto_fit";
+// a new fit has to hold for this many looks, so that dragging an item around doesn't switch at every step
+constexpr int FIT_SETTLE = 2;
 constexpr auto HW_DECODE = "hw_decode";
 constexpr auto IS_ADVANCED_SETTINGS_SHOW = "is_advanced_settings_show";
 constexpr auto ADVANCED_SETTINGS = "advanced_settings";
@@ -35,36 +54,369 @@ constexpr auto STREAMLINK_OPTIONS = "streamlink_options";
 constexpr auto HTTP_PROXY = "http_proxy";
 constexpr auto HTTPS_PROXY = "https_proxy";
 constexpr auto RING_BUFFER_SIZE = "ringbuffer_size";
+constexpr auto RING_BUFFER_AUTO = "ringbuffer_auto";
+constexpr auto RING_BUFFER_AUTO_TOOLTIP = "ringbuffer_auto_tooltip";
+constexpr auto RING_BUFFER_SECONDS = "ringbuffer_seconds";
+// what streamlink uses when no size is set
+constexpr size_t RING_BUFFER_DEFAULT = 16 * 1024 * 1024;
+constexpr size_t RING_BUFFER_AUTO_MAX = 256 * 1024 * 1024;
+// while the bandwidth limit holds reads back, the ring buffer holds at most this long at the enforced rate
+constexpr double RING_BUFFER_LIMITED_S = 8.0;
+// input is measured over this long, so that a few HLS segments fall into every sample
+constexpr float INPUT_SAMPLE_S = 5.0f;
 constexpr auto HLS_LIVE_EDGE = "hls_live_edge";
 constexpr auto HLS_SEGMENT_THREADS = "hls_segment_threads";
+constexpr auto HLS_AUTO = "hls_auto";
+constexpr auto HLS_AUTO_TOOLTIP = "hls_auto_tooltip";
+// how often HLS tuning looks at the stream, and after how many calm looks it lowers the settings again
+constexpr float HLS_TUNE_INTERVAL_S = 30.0f;
+constexpr int HLS_TUNE_CALM = 4;
+// segment download time against segment duration: above the high share a stall is near, under the calm share for
+// `HLS_TUNE_CALM` looks the settings come down again
+constexpr double HLS_LOAD_HIGH = 0.5;
+constexpr double HLS_LOAD_CALM = 0.25;
+// a look with fewer segments says nothing
+constexpr unsigned HLS_TUNE_MIN_SEGMENTS = 3;
+// calm looks needed after a stall, before lowering again
+constexpr int HLS_TUNE_HOLDOFF = 20;
+constexpr auto STOP_TIMEOUT = "stop_timeout";
+constexpr auto SEAMLESS_SWITCH = "seamless_switch";
+constexpr auto KEEP_WARM = "keep_warm";
+constexpr auto MEDIA_MODE = "media_mode";
+constexpr auto MEDIA_MODE_TOOLTIP = "media_mode_tooltip";
+constexpr auto MEDIA_MODE_AUDIO_VIDEO = "media_mode_audio_video";
+constexpr auto MEDIA_MODE_AUDIO_ONLY = "media_mode_audio_only";
+constexpr auto MEDIA_MODE_VIDEO_ONLY = "media_mode_video_only";
+constexpr auto KEYFRAMES_ONLY = "keyframes_only";
+constexpr auto KEYFRAMES_ONLY_TOOLTIP = "keyframes_only_tooltip";
+constexpr auto KEYFRAME_INTERVAL = "keyframe_interval";
+constexpr auto DOWNSCALE = "downscale";
+constexpr auto DOWNSCALE_TOOLTIP = "downscale_tooltip";
+constexpr auto DOWNSCALE_OFF = "downscale_off";
+constexpr auto DOWNSCALE_DISPLAYED = "downscale_displayed";
+constexpr auto DOWNSCALE_FIXED = "downscale_fixed";
+constexpr auto DOWNSCALE_WIDTH = "downscale_width";
+constexpr auto DOWNSCALE_HEIGHT = "downscale_height";
+constexpr auto REDUCE_TO_420 = "reduce_to_420";
+constexpr auto REDUCE_TO_420_TOOLTIP = "reduce_to_420_tooltip";
+constexpr auto WARM_BUFFER_LIMIT = "warm_buffer_limit";
+constexpr auto PREWARM_TIMEOUT = "prewarm_timeout";
+constexpr auto RESOLUTION_CACHE = "resolution_cache";
+constexpr auto RESOLUTION_CACHE_TOOLTIP = "resolution_cache_tooltip";
+constexpr auto RESOLUTION_CACHE_TTL = "resolution_cache_ttl";
+constexpr auto SHARE_DECODE = "share_decode";
+constexpr auto SHARE_DECODE_TOOLTIP = "share_decode_tooltip";
+constexpr auto RECORD = "record";
+constexpr auto RECORD_TOOLTIP = "record_tooltip";
+constexpr auto RECORD_PATH = "record_path";
+constexpr auto RECORD_SEGMENT = "record_segment";
+// how far the disk may fall behind before chunks are dropped
+constexpr size_t RECORD_QUEUE_LIMIT = 64 * 1024 * 1024;
+constexpr auto REPLAY = "replay";
+constexpr auto REPLAY_TOOLTIP = "replay_tooltip";
+constexpr auto REPLAY_LENGTH = "replay_length";
+constexpr auto REPLAY_MEMORY = "replay_memory";
+constexpr auto REPLAY_PATH = "replay_path";
+constexpr auto PASSTHROUGH = "passthrough";
+constexpr auto PASSTHROUGH_TOOLTIP = "passthrough_tooltip";
+constexpr auto SERVE = "serve";
+constexpr auto SERVE_TOOLTIP = "serve_tooltip";
+constexpr auto SERVE_PORT = "serve_port";
+// how far a client may fall behind before it skips ahead
+constexpr size_t SERVE_BUFFER_LIMIT = 16 * 1024 * 1024;
+// how often a port which could not be bound is tried again
+constexpr uint64_t SERVE_RETRY_NS = 10000000000ULL;
+// how long a timeshift seek waits for the feeder to let go of the previous pipe before reopening instead
+constexpr uint64_t SEEK_TIMEOUT_NS = 5000000000ULL;
+constexpr auto TIMESHIFT = "timeshift";
+constexpr auto TIMESHIFT_TOOLTIP = "timeshift_tooltip";
+constexpr auto TIMESHIFT_WINDOW = "timeshift_window";
+constexpr auto TIMESHIFT_MEMORY = "timeshift_memory";
+constexpr auto BANDWIDTH_LIMIT = "bandwidth_limit";
+// only read from sources saved before the total limit was module-wide
+constexpr auto BANDWIDTH_TOTAL_LIMIT = "bandwidth_total_limit";
+constexpr auto BANDWIDTH_TOTAL_LIMIT_INFO = "bandwidth_total_limit_info";
+constexpr auto BANDWIDTH_TOTAL_LIMIT_NONE = "bandwidth_total_limit_none";
+constexpr auto BANDWIDTH_LIMIT_TOOLTIP = "bandwidth_limit_tooltip";
+constexpr auto BANDWIDTH_TOTAL_LIMIT_TOOLTIP = "bandwidth_total_limit_tooltip";
 constexpr auto STREAMLINK_CUSTOM_OPTIONS = "streamlink_custom_options";
 constexpr auto FFMPEG_CUSTOM_OPTIONS = "ffmpeg_custom_options";
 constexpr auto STREAMLINK_CUSTOM_OPTIONS_TOOLTIP = "streamlink_custom_options_tooltip";
 constexpr auto FFMPEG_CUSTOM_OPTIONS_TOOLTIP = "ffmpeg_custom_options_tooltip";
+constexpr auto SEAMLESS_SWITCH_TOOLTIP = "seamless_switch_tooltip";
+constexpr auto START_AT_KEYFRAME = "start_at_keyframe";
+constexpr auto START_AT_KEYFRAME_TOOLTIP = "start_at_keyframe_tooltip";
+constexpr auto KEEP_WARM_TOOLTIP = "keep_warm_tooltip";
+
+// Whether decoded frames are scaled down, to the size the source is displayed at or to a fixed maximum.
+enum class downscale_mode : long long { off, displayed, fixed };
+
+// The subset of the settings that ends up as streamlink session options.
+struct session_config {
+	std::string http_proxy{};
+	std::string https_proxy{};
+	long long ringbuffer_size{};
+	long long hls_live_edge{};
+	long long hls_segment_threads{};
+	std::string custom_options{};
+
+	static session_config from_settings(obs_data_t *settings)
+	{
+		return {
+			obs_data_get_string(settings, HTTP_PROXY),
+			obs_data_get_string(settings, HTTPS_PROXY),
+			obs_data_get_int(settings, RING_BUFFER_SIZE),
+			obs_data_get_int(settings, HLS_LIVE_EDGE),
+			obs_data_get_int(settings, HLS_SEGMENT_THREADS),
+			obs_data_get_string(settings, STREAMLINK_CUSTOM_OPTIONS),
+		};
+	}
+
+	// These are only read by streamlink when a stream is opened, changing them needs a reopen to take effect.
+	bool transport_differs(const session_config &other) const
+	{
+		return ringbuffer_size != other.ringbuffer_size || hls_live_edge != other.hls_live_edge ||
+		       hls_segment_threads != other.hls_segment_threads;
+	}
+
+	bool operator==(const session_config &) const = default;
+};
+
+using resolved_streams = std::map<std::string, streamlink::StreamInfo>;
+
+// What "auto (fit)" has to cover: the height the source is shown at, 0 when unknown, and the canvas frame rate.
+struct definition_fit {
+	uint32_t height{};
+	double fps{};
+
+	bool operator==(const definition_fit &) const = default;
+};
+
+// The definitions "auto (fit)" last chose from and the one it picked, filled in by whichever thread resolved them.
+struct fit_state {
+	std::mutex mutex;
+	std::vector<std::string> names{};
+	std::string picked{};
+};
+
+// Segments downloaded since HLS tuning last looked, added by streamlink's fetch threads through
+// `Session::WatchSegments`.
+struct segment_timing {
+	std::mutex mutex;
+	unsigned segments{};
+	double download_s{};
+	double duration_s{};
+	// the highest download time of a single segment against its duration
+	double worst{};
+};
 
 struct streamlink_source {
 	mp_media_t media{};
 	bool media_valid{};
 	bool destroy_media{};
+	bool reopen_media{};
 
 	obs_source_t *source{};
 	obs_hotkey_id hotkey{};
+	obs_hotkey_id replay_hotkey{};
 
 	std::string live_room_url{};
 	std::string selected_definition{};
+	// only used with "auto (fit)", see `streamlink_source_refit`
+	definition_fit fit{};
+	std::shared_ptr<fit_state> fitting{std::make_shared<fit_state>()};
+	std::string fit_pending{};
+	int fit_pending_looks{};
+	float fit_elapsed{};
 	std::vector<std::string> available_definitions{};
 
 	bool is_hw_decoding{};
-
-	std::unique_ptr<streamlink::Stream> stream;
-	std::unique_ptr<streamlink::Session> streamlink_session;
+	pipe_filter filter{};
+	long long stop_timeout_ms{};
+	bool seamless_switch{};
+	bool start_at_keyframe{};
+	// when the current decoder was set up, until its first frame
+	std::atomic<uint64_t> open_ts{};
+	// see `stream_format_hint`, empty when unknown
+	std::string input_format{};
+	// set once a hinted open produced nothing, probing stays complete for this URL from then on
+	bool full_probe{};
+	std::atomic_bool media_received{};
+
+	// decode rate and time, sampled by `streamlink_source_sample_decode` about once a second
+	std::atomic<uint64_t> frames_decoded{};
+	uint64_t frames_sampled{};
+	uint64_t decode_cpu_ns_sampled{};
+	float decode_sample_elapsed{};
+	double decode_fps{};
+	double decode_ms_per_s{};
+
+	// input rate, sampled by `streamlink_source_size_buffer` every `INPUT_SAMPLE_S`
+	bool ring_buffer_auto{};
+	long long ring_buffer_seconds{};
+	float input_sample_elapsed{};
+	uint64_t input_bytes_sampled{};
+	double input_bytes_per_s{};
+
+	downscale_mode downscale{};
+	uint32_t downscale_fixed_width{};
+	uint32_t downscale_fixed_height{};
+	// read by the media thread for every frame, 0 for no limit
+	std::atomic<uint32_t> max_width{};
+	std::atomic<uint32_t> max_height{};
+	frame_scaler scaler;
+	std::atomic_bool reduce_to_420{};
+	pixel_converter converter;
+	// media thread only, averaged into `convert_ms` by `streamlink_source_sample_decode`
+	std::atomic<uint64_t> convert_ns{};
+	std::atomic<uint64_t> frames_converted{};
+	double convert_ms{};
+	bool keep_warm{};
+	long long warm_buffer_limit_mb{};
+	long long prewarm_timeout_s{};
+	bool resolution_cache{};
+	long long resolution_cache_ttl_min{};
+
+	// see `streamlink_source_share_key`, empty when sharing is off
+	bool share_decode{};
+	std::string share_key{};
+	// guards `shared`, which the media thread hands frames to while this source owns the decoder
+	std::mutex share_mutex;
+	std::shared_ptr<shared_decode> shared;
+	// set instead of decoding, while showing what another source decodes
+	std::shared_ptr<shared_decode> subscribed;
+	// hidden, but still decoding for the sources subscribed to it
+	bool kept_for_subscribers{};
+
+	// tees everything the writer reads, kept across reopens
+	bool record{};
+	std::string record_path{};
+	long long record_segment_s{};
+	std::shared_ptr<recorder> recording;
+
+	// the last seconds of what the writer reads, kept across reopens until saved as a clip
+	bool replay_enabled{};
+	long long replay_memory_mb{};
+	// guards the three below, which the save hotkey and proc read from their own threads
+	std::mutex replay_mutex;
+	long long replay_length_s{};
+	std::string replay_path{};
+	std::shared_ptr<replay_buffer> replay;
+
+	// only reads for recording, replay and serving, without decoding; runs whether shown or not
+	bool passthrough{};
+
+	// live edge and segment threads in use when tuned automatically, the configured ones otherwise;
+	// see `streamlink_source_tune_hls`
+	bool hls_auto{};
+	long long hls_live_edge{};
+	long long hls_segment_threads{};
+	float hls_tune_elapsed{};
+	int hls_calm{};
+	uint64_t hls_stalls{};
+	// outlives the source while the session's hook holds it
+	std::shared_ptr<segment_timing> hls_timing{std::make_shared<segment_timing>()};
+
+	// paces the downloads of every writer of this source, for as long as the source exists
+	std::shared_ptr<bandwidth_limit> bandwidth;
+
+	// serves what the writer reads to local players, kept across reopens
+	bool serve_enabled{};
+	long long serve_port{};
+	// guards the two below, replaced from the UI thread by an update and from the tick when the port comes free
+	std::mutex serve_mutex;
+	std::shared_ptr<http_server> serving;
+	uint64_t serve_failed_ts{};
+
+	// cumulative segment start times of a VOD, empty for live streams; `vod_checked` once the writer looked
+	std::mutex vod_mutex;
+	std::vector<int64_t> vod_segment_starts_ms{};
+	std::atomic<int64_t> vod_duration_ms{};
+	bool vod_checked{};
+	// where in the VOD the current open started, and how far playback got from there
+	std::atomic<int64_t> vod_start_ms{};
+	std::atomic_bool vod_frame_seen{};
+	std::atomic<uint64_t> vod_first_frame_ts{};
+	std::atomic<int64_t> vod_played_ms{};
+
+	// input kept in memory so that playback can be paused and moved around in, see `timeshift`
+	bool timeshift_enabled{};
+	// the pipe a timeshift seek waits for, empty when none, see `streamlink_source_finish_seek`
+	std::mutex seek_mutex;
+	std::string seek_pipe_path{};
+	uint64_t seek_ts{};
+	long long timeshift_window_min{};
+	long long timeshift_memory_mb{};
+
+	// opened ahead of time by the `prepare` proc, taken over by the next start
+	std::mutex prepare_mutex;
+	std::condition_variable prepare_cv;
+	std::shared_ptr<pipe_writer> prepared;
+	std::string prepared_format{};
+	// only resolved at scene collection load, the next open picks from these instead of asking the plugin again
+	std::shared_ptr<resolved_streams> resolved;
+	uint64_t prepared_ts{};
+	// a prepare for what is current is on the worker pool; `prepare_running` counts stale ones as well
+	bool prepare_queued{};
+	unsigned prepare_running{};
+	// bumped when what is prepared no longer applies, a prepare still running then throws its result away
+	unsigned long prepare_generation{};
+	// a start which came while preparing, done by the tick once ready instead of waiting for it
+	bool start_deferred{};
+	// set by the `prepare` proc on whichever thread calls it, queued by the next tick
+	std::atomic_bool prepare_requested{};
+	// counted in `load_batch` until its first frame
+	std::atomic_bool in_load_batch{};
+
+	std::shared_ptr<streamlink::Stream> stream;
+	std::shared_ptr<streamlink::Session> streamlink_session;
+	std::optional<session_config> session_cfg;
 
 	std::string pipe_path{};
-	pthread_t thread;
-	os_event_t *stop_signal;
+	unsigned long pipe_generation{};
+	std::shared_ptr<pipe_writer> writer;
 };
 using streamlink_source_t = struct streamlink_source;
 
+// Sources created in a burst, like at scene collection load, are prepared in parallel. This tracks how long the
+// whole burst takes to show its first frames.
+static struct {
+	std::mutex mutex;
+	uint64_t start_ts{};
+	uint64_t last_frame_ts{};
+	unsigned pending{};
+	unsigned total{};
+	unsigned shown{};
+} load_batch;
+
+static void load_batch_join(streamlink_source_t *s)
+{
+	std::lock_guard lock{load_batch.mutex};
+	if (load_batch.pending == 0) {
+		load_batch.start_ts = os_gettime_ns();
+		load_batch.total = 0;
+		load_batch.shown = 0;
+	}
+	load_batch.pending++;
+	load_batch.total++;
+	s->in_load_batch = true;
+}
+
+static void load_batch_leave(streamlink_source_t *s, bool first_frame)
+{
+	if (!s->in_load_batch.exchange(false))
+		return;
+	std::lock_guard lock{load_batch.mutex};
+	if (first_frame) {
+		load_batch.shown++;
+		load_batch.last_frame_ts = os_gettime_ns();
+	}
+	if (--load_batch.pending > 0 || load_batch.shown == 0)
+		return;
+	FF_LOG(LOG_INFO, "%u of %u source(s) loaded together showed their first frame within %.0f ms", load_batch.shown,
+	       load_batch.total, static_cast<double>(load_batch.last_frame_ts - load_batch.start_ts) / 1000000.0);
+}
+
 void set_streamlink_custom_options(const char* custom_options_s, streamlink_source_t* s)
 {
 	if (strlen(custom_options_s) == 0)
@@ -97,35 +449,77 @@ void set_streamlink_custom_options(const char* custom_options_s, streamlink_sour
 	}
 }
 
+static std::vector<std::string> custom_option_keys(const std::string &custom_options_s)
+{
+	std::vector<std::string> keys{};
+	auto custom_options = nlohmann::json::parse(custom_options_s, nullptr, false);
+	if (custom_options.is_object())
+		for (auto& [key, value] : custom_options.items())
+			keys.emplace_back(key);
+	return keys;
+}
+
+// Options can be set on a live session but not unset, a cleared proxy or a removed custom option needs a new session.
+static bool session_options_removed(const session_config &old_cfg, const session_config &cfg)
+{
+	if ((!old_cfg.http_proxy.empty() && cfg.http_proxy.empty()) ||
+	    (!old_cfg.https_proxy.empty() && cfg.https_proxy.empty()) ||
+	    (old_cfg.ringbuffer_size > 0 && cfg.ringbuffer_size <= 0))
+		return true;
+	if (old_cfg.custom_options == cfg.custom_options)
+		return false;
+	const auto new_keys = custom_option_keys(cfg.custom_options);
+	for (const auto &key : custom_option_keys(old_cfg.custom_options))
+		if (std::find(new_keys.begin(), new_keys.end(), key) == new_keys.end())
+			return true;
+	return false;
+}
+
 bool update_streamlink_session(void* data, obs_data_t* settings) {
     auto* s = static_cast<streamlink_source_t*>(data);
 
-	const char* http_proxy_s = obs_data_get_string(settings, HTTP_PROXY);
-	const char* https_proxy_s = obs_data_get_string(settings, HTTPS_PROXY);
-	const long long ringbuffer_size = obs_data_get_int(settings, RING_BUFFER_SIZE);
-	const long long hls_live_edge = obs_data_get_int(settings, HLS_LIVE_EDGE);
-	const long long hls_segment_threads = obs_data_get_int(settings, HLS_SEGMENT_THREADS);
-	const char* custom_options_s = obs_data_get_string(settings, STREAMLINK_CUSTOM_OPTIONS);
-	//const char* streamlink_options_s = obs_data_get_string(settings, STREAMLINK_OPTIONS);
+	const auto cfg = session_config::from_settings(settings);
+	if (s->streamlink_session && s->session_cfg && *s->session_cfg == cfg)
+		return true;
+
+	// With a live session only the changed options are applied, the open stream keeps playing.
+	const session_config *old_cfg = s->streamlink_session && s->session_cfg ? &*s->session_cfg : nullptr;
+	if (old_cfg && session_options_removed(*old_cfg, cfg))
+		old_cfg = nullptr;
+
 	streamlink::ThreadGIL state = streamlink::ThreadGIL();
 	try {
-		s->streamlink_session = std::make_unique<streamlink::Session>();
-
-		if(strlen(http_proxy_s)>1)
-			s->streamlink_session->SetOptionString("http-proxy", http_proxy_s);
-		if (strlen(https_proxy_s) > 1)
-			s->streamlink_session->SetOptionString("https-proxy", https_proxy_s);
-		if(ringbuffer_size>0)
-			s->streamlink_session->SetOptionInt("ringbuffer-size", static_cast<long long>(ringbuffer_size) * 1024 * 1024);
-		s->streamlink_session->SetOptionInt("hls-live-edge", hls_live_edge);
-		s->streamlink_session->SetOptionInt("hls-segment-threads", hls_segment_threads);
-		s->streamlink_session->SetOptionDouble("http-timeout", 5.0);
-		s->streamlink_session->SetOptionString("ffmpeg-ffmpeg", "A:/ffmpeg-5.1.2-full_build-shared/bin/ffmpeg.exe");
-		set_streamlink_custom_options(custom_options_s, s);
+		if (!old_cfg) {
+			s->streamlink_session = std::make_shared<streamlink::Session>();
+			s->streamlink_session->WatchSegments([timing = s->hls_timing](double download_s, double duration_s) {
+				std::lock_guard lock{timing->mutex};
+				timing->segments++;
+				timing->download_s += download_s;
+				timing->duration_s += duration_s;
+				timing->worst = std::max(timing->worst, download_s / duration_s);
+			});
+			s->streamlink_session->SetOptionDouble("http-timeout", 5.0);
+			s->streamlink_session->SetOptionString("ffmpeg-ffmpeg", "A:/ffmpeg-5.1.2-full_build-shared/bin/ffmpeg.exe");
+		}
+
+		if (cfg.http_proxy.size() > 1 && (!old_cfg || old_cfg->http_proxy != cfg.http_proxy))
+			s->streamlink_session->SetOptionString("http-proxy", cfg.http_proxy);
+		if (cfg.https_proxy.size() > 1 && (!old_cfg || old_cfg->https_proxy != cfg.https_proxy))
+			s->streamlink_session->SetOptionString("https-proxy", cfg.https_proxy);
+		if (cfg.ringbuffer_size > 0 && (!old_cfg || old_cfg->ringbuffer_size != cfg.ringbuffer_size))
+			s->streamlink_session->SetOptionInt("ringbuffer-size", static_cast<long long>(cfg.ringbuffer_size) * 1024 * 1024);
+		if (!old_cfg || old_cfg->hls_live_edge != cfg.hls_live_edge)
+			s->streamlink_session->SetOptionInt("hls-live-edge", cfg.hls_live_edge);
+		if (!old_cfg || old_cfg->hls_segment_threads != cfg.hls_segment_threads)
+			s->streamlink_session->SetOptionInt("hls-segment-threads", cfg.hls_segment_threads);
+		if (!old_cfg || old_cfg->custom_options != cfg.custom_options)
+			set_streamlink_custom_options(cfg.custom_options.c_str(), s);
+		s->session_cfg = cfg;
 		return true;
 	}
 	catch (std::exception & ex) {
 		FF_BLOG(LOG_WARNING, "Error initializing streamlink session: %s", ex.what());
+		s->session_cfg.reset();
 		return false;
 	}
 }
@@ -133,8 +527,37 @@ static void streamlink_source_defaults(obs_data_t *settings)
 {
 	obs_data_set_default_string(settings, DEFINITIONS, "best");
 	obs_data_set_default_int(settings, RING_BUFFER_SIZE, 16);
+	obs_data_set_default_bool(settings, RING_BUFFER_AUTO, false);
+	obs_data_set_default_int(settings, RING_BUFFER_SECONDS, 10);
 	obs_data_set_default_int(settings, HLS_LIVE_EDGE, 8);
 	obs_data_set_default_int(settings, HLS_SEGMENT_THREADS, 3);
+	obs_data_set_default_bool(settings, HLS_AUTO, false);
+	obs_data_set_default_int(settings, STOP_TIMEOUT, 100);
+	obs_data_set_default_bool(settings, SEAMLESS_SWITCH, true);
+	obs_data_set_default_int(settings, MEDIA_MODE, static_cast<long long>(media_mode::audio_video));
+	obs_data_set_default_bool(settings, KEYFRAMES_ONLY, false);
+	obs_data_set_default_int(settings, KEYFRAME_INTERVAL, 0);
+	obs_data_set_default_bool(settings, START_AT_KEYFRAME, true);
+	obs_data_set_default_int(settings, WARM_BUFFER_LIMIT, 16);
+	obs_data_set_default_int(settings, DOWNSCALE, static_cast<long long>(downscale_mode::off));
+	obs_data_set_default_int(settings, DOWNSCALE_WIDTH, 640);
+	obs_data_set_default_int(settings, DOWNSCALE_HEIGHT, 360);
+	obs_data_set_default_bool(settings, REDUCE_TO_420, false);
+	obs_data_set_default_int(settings, PREWARM_TIMEOUT, 60);
+	obs_data_set_default_int(settings, RESOLUTION_CACHE_TTL, 10);
+	obs_data_set_default_bool(settings, SHARE_DECODE, true);
+	obs_data_set_default_bool(settings, RECORD, false);
+	obs_data_set_default_int(settings, RECORD_SEGMENT, 300);
+	obs_data_set_default_bool(settings, REPLAY, false);
+	obs_data_set_default_int(settings, REPLAY_LENGTH, 60);
+	obs_data_set_default_int(settings, REPLAY_MEMORY, 256);
+	obs_data_set_default_int(settings, BANDWIDTH_LIMIT, 0);
+	obs_data_set_default_bool(settings, PASSTHROUGH, false);
+	obs_data_set_default_bool(settings, SERVE, false);
+	obs_data_set_default_int(settings, SERVE_PORT, 8899);
+	obs_data_set_default_bool(settings, TIMESHIFT, false);
+	obs_data_set_default_int(settings, TIMESHIFT_WINDOW, 10);
+	obs_data_set_default_int(settings, TIMESHIFT_MEMORY, 512);
 	obs_data_set_default_string(settings, STREAMLINK_CUSTOM_OPTIONS, "{}");
 }
 
@@ -150,6 +573,7 @@ bool refresh_definitions(obs_properties_t* props,obs_property_t* prop,void* data
 	try {
 		obs_property_t* list = obs_properties_get(props,DEFINITIONS);
 		obs_property_list_clear(list);
+		obs_property_list_add_string(list, obs_module_text(DEFINITION_AUTO_FIT_TEXT), DEFINITION_AUTO_FIT);
 		s->available_definitions = std::vector<std::string>{}; // https://github.com/microsoft/STL/issues/1934
 		const auto streams = s->streamlink_session->GetStreamsFromUrl(url);
 		for (const auto& [definition, stream_info] : streams) {
@@ -164,6 +588,22 @@ bool refresh_definitions(obs_properties_t* props,obs_property_t* prop,void* data
 	}
 }
 
+// The total limit is module-wide, only shown here along with where it is set.
+static void streamlink_source_add_total_limit(obs_properties_t *props)
+{
+	const uint64_t mbps = bandwidth_limit_total() / 125000;
+	const std::string value = mbps ? std::to_string(mbps) + " Mbps" : obs_module_text(BANDWIDTH_TOTAL_LIMIT_NONE);
+	char text[256];
+	snprintf(text, sizeof(text), obs_module_text(BANDWIDTH_TOTAL_LIMIT_INFO), value.c_str());
+	obs_property_t *prop = obs_properties_add_text(props, BANDWIDTH_TOTAL_LIMIT_INFO, text, OBS_TEXT_INFO);
+
+	char *path = obs_module_config_path(BANDWIDTH_LIMIT_FILE);
+	char tooltip[2048];
+	snprintf(tooltip, sizeof(tooltip), obs_module_text(BANDWIDTH_TOTAL_LIMIT_TOOLTIP), path ? path : BANDWIDTH_LIMIT_FILE);
+	bfree(path);
+	obs_property_set_long_description(prop, tooltip);
+}
+
 static obs_properties_t *streamlink_source_getproperties(void *data)
 {
 	// ReSharper disable CppAssignedValueIsNeverUsed
@@ -175,14 +615,7 @@ static obs_properties_t *streamlink_source_getproperties(void *data)
     obs_property_t* prop;
     prop = obs_properties_add_text(props, URL, obs_module_text(URL), OBS_TEXT_DEFAULT);
 	prop = obs_properties_add_list(props, DEFINITIONS, obs_module_text(DEFINITIONS), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
-	obs_property_set_modified_callback2(prop, [](void* priv, obs_properties_t*, obs_property_t* prop, obs_data_t* data) -> bool {
-        const auto s = static_cast<streamlink_source_t*>(priv);
-		auto propName = obs_property_name(prop);
-		if (!propName || std::strcmp(propName, DEFINITIONS) != 0) return false;
-		auto def = obs_data_get_string(data, DEFINITIONS);
-		s->selected_definition = std::string{def};
-		return false; // TODO find out WHY?
-	}, s);
+	obs_property_list_add_string(prop, obs_module_text(DEFINITION_AUTO_FIT_TEXT), DEFINITION_AUTO_FIT);
 	for (const auto& def : s->available_definitions)
 		obs_property_list_add_string(prop, def.c_str(), def.c_str());
 	prop = obs_properties_add_button2(props,REFRESH_DEFINITIONS, obs_module_text(REFRESH_DEFINITIONS), refresh_definitions, s);
@@ -190,6 +623,90 @@ static obs_properties_t *streamlink_source_getproperties(void *data)
 	obs_properties_add_bool(props, HW_DECODE,
 				obs_module_text(HW_DECODE));
 #endif
+	prop = obs_properties_add_list(props, MEDIA_MODE, obs_module_text(MEDIA_MODE), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_set_long_description(prop, obs_module_text(MEDIA_MODE_TOOLTIP));
+	obs_property_list_add_int(prop, obs_module_text(MEDIA_MODE_AUDIO_VIDEO), static_cast<long long>(media_mode::audio_video));
+	obs_property_list_add_int(prop, obs_module_text(MEDIA_MODE_AUDIO_ONLY), static_cast<long long>(media_mode::audio_only));
+	obs_property_list_add_int(prop, obs_module_text(MEDIA_MODE_VIDEO_ONLY), static_cast<long long>(media_mode::video_only));
+	prop = obs_properties_add_bool(props, KEYFRAMES_ONLY, obs_module_text(KEYFRAMES_ONLY));
+	obs_property_set_long_description(prop, obs_module_text(KEYFRAMES_ONLY_TOOLTIP));
+	obs_property_set_modified_callback(prop, [](obs_properties_t* props, obs_property_t* prop, obs_data_t* settings)->bool{
+		UNUSED_PARAMETER(prop);
+		obs_property_set_visible(obs_properties_get(props, KEYFRAME_INTERVAL), obs_data_get_bool(settings, KEYFRAMES_ONLY));
+		return true;
+		});
+	prop = obs_properties_add_int(props, KEYFRAME_INTERVAL, obs_module_text(KEYFRAME_INTERVAL), 0, 60000, 100);
+	obs_property_int_set_suffix(prop, " ms");
+	prop = obs_properties_add_bool(props, KEEP_WARM, obs_module_text(KEEP_WARM));
+	obs_property_set_long_description(prop, obs_module_text(KEEP_WARM_TOOLTIP));
+	prop = obs_properties_add_list(props, DOWNSCALE, obs_module_text(DOWNSCALE), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_set_long_description(prop, obs_module_text(DOWNSCALE_TOOLTIP));
+	obs_property_list_add_int(prop, obs_module_text(DOWNSCALE_OFF), static_cast<long long>(downscale_mode::off));
+	obs_property_list_add_int(prop, obs_module_text(DOWNSCALE_DISPLAYED), static_cast<long long>(downscale_mode::displayed));
+	obs_property_list_add_int(prop, obs_module_text(DOWNSCALE_FIXED), static_cast<long long>(downscale_mode::fixed));
+	obs_property_set_modified_callback(prop, [](obs_properties_t* props, obs_property_t* prop, obs_data_t* settings)->bool{
+		UNUSED_PARAMETER(prop);
+		const bool fixed = obs_data_get_int(settings, DOWNSCALE) == static_cast<long long>(downscale_mode::fixed);
+		obs_property_set_visible(obs_properties_get(props, DOWNSCALE_WIDTH), fixed);
+		obs_property_set_visible(obs_properties_get(props, DOWNSCALE_HEIGHT), fixed);
+		return true;
+		});
+	prop = obs_properties_add_int(props, DOWNSCALE_WIDTH, obs_module_text(DOWNSCALE_WIDTH), 16, 7680, 2);
+	obs_property_int_set_suffix(prop, " px");
+	prop = obs_properties_add_int(props, DOWNSCALE_HEIGHT, obs_module_text(DOWNSCALE_HEIGHT), 16, 4320, 2);
+	obs_property_int_set_suffix(prop, " px");
+	prop = obs_properties_add_bool(props, REDUCE_TO_420, obs_module_text(REDUCE_TO_420));
+	obs_property_set_long_description(prop, obs_module_text(REDUCE_TO_420_TOOLTIP));
+	prop = obs_properties_add_bool(props, RECORD, obs_module_text(RECORD));
+	obs_property_set_long_description(prop, obs_module_text(RECORD_TOOLTIP));
+	obs_property_set_modified_callback(prop, [](obs_properties_t* props, obs_property_t* prop, obs_data_t* settings)->bool{
+		UNUSED_PARAMETER(prop);
+		const bool record = obs_data_get_bool(settings, RECORD);
+		obs_property_set_visible(obs_properties_get(props, RECORD_PATH), record);
+		obs_property_set_visible(obs_properties_get(props, RECORD_SEGMENT), record);
+		return true;
+		});
+	obs_properties_add_path(props, RECORD_PATH, obs_module_text(RECORD_PATH), OBS_PATH_DIRECTORY, nullptr, nullptr);
+	prop = obs_properties_add_int(props, RECORD_SEGMENT, obs_module_text(RECORD_SEGMENT), 10, 3600, 10);
+	obs_property_int_set_suffix(prop, " s");
+	prop = obs_properties_add_bool(props, REPLAY, obs_module_text(REPLAY));
+	obs_property_set_long_description(prop, obs_module_text(REPLAY_TOOLTIP));
+	obs_property_set_modified_callback(prop, [](obs_properties_t* props, obs_property_t* prop, obs_data_t* settings)->bool{
+		UNUSED_PARAMETER(prop);
+		const bool replay = obs_data_get_bool(settings, REPLAY);
+		obs_property_set_visible(obs_properties_get(props, REPLAY_PATH), replay);
+		obs_property_set_visible(obs_properties_get(props, REPLAY_LENGTH), replay);
+		obs_property_set_visible(obs_properties_get(props, REPLAY_MEMORY), replay);
+		return true;
+		});
+	obs_properties_add_path(props, REPLAY_PATH, obs_module_text(REPLAY_PATH), OBS_PATH_DIRECTORY, nullptr, nullptr);
+	prop = obs_properties_add_int(props, REPLAY_LENGTH, obs_module_text(REPLAY_LENGTH), 5, 3600, 5);
+	obs_property_int_set_suffix(prop, " s");
+	prop = obs_properties_add_int(props, REPLAY_MEMORY, obs_module_text(REPLAY_MEMORY), 16, 4096, 16);
+	obs_property_int_set_suffix(prop, " MB");
+	prop = obs_properties_add_bool(props, PASSTHROUGH, obs_module_text(PASSTHROUGH));
+	obs_property_set_long_description(prop, obs_module_text(PASSTHROUGH_TOOLTIP));
+	prop = obs_properties_add_bool(props, SERVE, obs_module_text(SERVE));
+	obs_property_set_long_description(prop, obs_module_text(SERVE_TOOLTIP));
+	obs_property_set_modified_callback(prop, [](obs_properties_t* props, obs_property_t* prop, obs_data_t* settings)->bool{
+		UNUSED_PARAMETER(prop);
+		obs_property_set_visible(obs_properties_get(props, SERVE_PORT), obs_data_get_bool(settings, SERVE));
+		return true;
+		});
+	obs_properties_add_int(props, SERVE_PORT, obs_module_text(SERVE_PORT), 1024, 65535, 1);
+	prop = obs_properties_add_bool(props, TIMESHIFT, obs_module_text(TIMESHIFT));
+	obs_property_set_long_description(prop, obs_module_text(TIMESHIFT_TOOLTIP));
+	obs_property_set_modified_callback(prop, [](obs_properties_t* props, obs_property_t* prop, obs_data_t* settings)->bool{
+		UNUSED_PARAMETER(prop);
+		const bool timeshift = obs_data_get_bool(settings, TIMESHIFT);
+		obs_property_set_visible(obs_properties_get(props, TIMESHIFT_WINDOW), timeshift);
+		obs_property_set_visible(obs_properties_get(props, TIMESHIFT_MEMORY), timeshift);
+		return true;
+		});
+	prop = obs_properties_add_int(props, TIMESHIFT_WINDOW, obs_module_text(TIMESHIFT_WINDOW), 1, 240, 1);
+	obs_property_int_set_suffix(prop, " min");
+	prop = obs_properties_add_int(props, TIMESHIFT_MEMORY, obs_module_text(TIMESHIFT_MEMORY), 16, 16384, 16);
+	obs_property_int_set_suffix(prop, " MB");
 	obs_property_t* is_advanced_settings_show = obs_properties_add_bool(props, IS_ADVANCED_SETTINGS_SHOW, obs_module_text(IS_ADVANCED_SETTINGS_SHOW));
 	obs_property_set_modified_callback(is_advanced_settings_show, [](obs_properties_t* props, obs_property_t* prop, obs_data_t* settings)->bool{
 		UNUSED_PARAMETER(prop);
@@ -202,8 +719,34 @@ static obs_properties_t *streamlink_source_getproperties(void *data)
 	prop = obs_properties_add_text(advanced_settings, HTTP_PROXY, obs_module_text(HTTP_PROXY), OBS_TEXT_DEFAULT);
     prop = obs_properties_add_text(advanced_settings, HTTPS_PROXY, obs_module_text(HTTPS_PROXY), OBS_TEXT_DEFAULT);
     prop = obs_properties_add_int(advanced_settings, RING_BUFFER_SIZE, obs_module_text(RING_BUFFER_SIZE), 0, 256, 1);
+	prop = obs_properties_add_bool(advanced_settings, RING_BUFFER_AUTO, obs_module_text(RING_BUFFER_AUTO));
+	obs_property_set_long_description(prop, obs_module_text(RING_BUFFER_AUTO_TOOLTIP));
+	prop = obs_properties_add_int(advanced_settings, RING_BUFFER_SECONDS, obs_module_text(RING_BUFFER_SECONDS), 2, 120, 1);
+	obs_property_int_set_suffix(prop, " s");
 	prop = obs_properties_add_int(advanced_settings, HLS_LIVE_EDGE, obs_module_text(HLS_LIVE_EDGE), 1, 20, 1);
 	prop = obs_properties_add_int(advanced_settings, HLS_SEGMENT_THREADS, obs_module_text(HLS_SEGMENT_THREADS), 1, 10, 1);
+	prop = obs_properties_add_bool(advanced_settings, HLS_AUTO, obs_module_text(HLS_AUTO));
+	obs_property_set_long_description(prop, obs_module_text(HLS_AUTO_TOOLTIP));
+	prop = obs_properties_add_int(advanced_settings, STOP_TIMEOUT, obs_module_text(STOP_TIMEOUT), 20, 5000, 10);
+	obs_property_int_set_suffix(prop, " ms");
+	prop = obs_properties_add_bool(advanced_settings, SEAMLESS_SWITCH, obs_module_text(SEAMLESS_SWITCH));
+	obs_property_set_long_description(prop, obs_module_text(SEAMLESS_SWITCH_TOOLTIP));
+	prop = obs_properties_add_bool(advanced_settings, START_AT_KEYFRAME, obs_module_text(START_AT_KEYFRAME));
+	obs_property_set_long_description(prop, obs_module_text(START_AT_KEYFRAME_TOOLTIP));
+	prop = obs_properties_add_int(advanced_settings, WARM_BUFFER_LIMIT, obs_module_text(WARM_BUFFER_LIMIT), 1, 256, 1);
+	obs_property_int_set_suffix(prop, " MB");
+	prop = obs_properties_add_int(advanced_settings, PREWARM_TIMEOUT, obs_module_text(PREWARM_TIMEOUT), 5, 600, 5);
+	obs_property_int_set_suffix(prop, " s");
+	prop = obs_properties_add_bool(advanced_settings, RESOLUTION_CACHE, obs_module_text(RESOLUTION_CACHE));
+	obs_property_set_long_description(prop, obs_module_text(RESOLUTION_CACHE_TOOLTIP));
+	prop = obs_properties_add_int(advanced_settings, RESOLUTION_CACHE_TTL, obs_module_text(RESOLUTION_CACHE_TTL), 1, 1440, 1);
+	obs_property_int_set_suffix(prop, " min");
+	prop = obs_properties_add_bool(advanced_settings, SHARE_DECODE, obs_module_text(SHARE_DECODE));
+	obs_property_set_long_description(prop, obs_module_text(SHARE_DECODE_TOOLTIP));
+	prop = obs_properties_add_int(advanced_settings, BANDWIDTH_LIMIT, obs_module_text(BANDWIDTH_LIMIT), 0, 10000, 1);
+	obs_property_int_set_suffix(prop, " Mbps");
+	obs_property_set_long_description(prop, obs_module_text(BANDWIDTH_LIMIT_TOOLTIP));
+	streamlink_source_add_total_limit(advanced_settings);
 
 	prop = obs_properties_add_text(advanced_settings, STREAMLINK_CUSTOM_OPTIONS, obs_module_text(STREAMLINK_CUSTOM_OPTIONS), OBS_TEXT_MULTILINE);
 	obs_property_set_long_description(prop, obs_module_text(STREAMLINK_CUSTOM_OPTIONS_TOOLTIP));
@@ -222,285 +765,1648 @@ static obs_properties_t *streamlink_source_getproperties(void *data)
 	// ReSharper restore CppJoinDeclarationAndAssignment
 }
 
+// Whatever is done to frames between the decoder and OBS, on the media thread. Scaling goes first, so that there
+// are fewer pixels to convert.
+static const obs_source_frame *streamlink_source_process_frame(streamlink_source_t *s, const obs_source_frame *f)
+{
+	const obs_source_frame *out = frame_scaler_scale(s->scaler, f, s->max_width, s->max_height);
+	if (!s->reduce_to_420)
+		return out;
+	const uint64_t start_ts = os_gettime_ns();
+	const obs_source_frame *converted = pixel_convert_to_420(s->converter, out);
+	if (converted != out) {
+		s->convert_ns += os_gettime_ns() - start_ts;
+		s->frames_converted++;
+	}
+	return converted;
+}
+
 static void get_frame(void *opaque, struct obs_source_frame *f)
 {
 	auto *s = static_cast<streamlink_source_t*>(opaque);
-	obs_source_output_video(s->source, f);
+	const obs_source_frame *out = streamlink_source_process_frame(s, f);
+	obs_source_output_video(s->source, out);
+	{
+		std::lock_guard lock{s->share_mutex};
+		if (s->shared)
+			shared_decode_output_video(s->shared, out);
+	}
+	load_batch_leave(s, true);
+	if (!s->vod_frame_seen.exchange(true))
+		s->vod_first_frame_ts = f->timestamp;
+	s->vod_played_ms = static_cast<int64_t>((f->timestamp - s->vod_first_frame_ts) / 1000000);
+	s->media_received = true;
+	s->frames_decoded++;
+	if (const uint64_t open_ts = s->open_ts.exchange(0))
+		FF_BLOG(LOG_INFO, "first frame %.0f ms after opening", static_cast<double>(os_gettime_ns() - open_ts) / 1000000.0);
 	// FF_LOG(LOG_INFO, "get_frame: %u", *f->data);
 }
 
 static void preload_frame(void *opaque, struct obs_source_frame *f)
 {
 	auto *s = static_cast<streamlink_source_t*>(opaque);
-	obs_source_preload_video(s->source, f);
+	obs_source_preload_video(s->source, streamlink_source_process_frame(s, f));
 }
 
 static void seek_frame(void* opaque, struct obs_source_frame* f)
 {
 	auto* s = static_cast<streamlink_source_t*>(opaque);
-	obs_source_set_video_frame(s->source, f);
+	const obs_source_frame *out = streamlink_source_process_frame(s, f);
+	obs_source_set_video_frame(s->source, out);
+	std::lock_guard lock{s->share_mutex};
+	if (s->shared)
+		shared_decode_output_video(s->shared, out);
 }
 
 static void get_audio(void *opaque, struct obs_source_audio *a)
 {
 	const auto s = static_cast<streamlink_source_t*>(opaque);
 	obs_source_output_audio(s->source, a);
+	{
+		std::lock_guard lock{s->share_mutex};
+		if (s->shared)
+			shared_decode_output_audio(s->shared, a);
+	}
+	s->media_received = true;
 }
 
 static void media_stopped(void *opaque)
 {
 	const auto s = static_cast<streamlink_source_t*>(opaque);
 	obs_source_output_video(s->source, nullptr);
-	if (s->media_valid)
-		s->destroy_media = true;
+	if (!s->media_valid)
+		return;
+	// media-playback stops right away when FFmpeg can't open the input, maybe the hint was wrong
+	if (!s->media_received && !s->input_format.empty() && !s->full_probe) {
+		FF_BLOG(LOG_INFO, "nothing decoded with input format \"%s\", retrying with full probing", s->input_format.c_str());
+		s->full_probe = true;
+		s->reopen_media = true;
+	}
+	s->destroy_media = true;
 }
 
-int streamlink_open(streamlink_source_t* c) {
-	auto state = streamlink::ThreadGIL();
-	try {
-		auto streams = c->streamlink_session->GetStreamsFromUrl(c->live_room_url);
-		c->stream.reset();
-		auto pref = streams.find(c->selected_definition);
-		if (pref == streams.end())
-			pref = streams.find("best");
-		if (pref == streams.end())
-			pref = streams.begin();
-		if (pref == streams.end()) {
-			FF_LOG(LOG_WARNING, "No streams found for live url %s", c->live_room_url.c_str());
-			return -1;
-		}
-		auto udly = pref->second.Open();
-		c->stream = std::make_unique<streamlink::Stream>(udly);
-	}catch (std::exception & ex) {
-		FF_LOG(LOG_WARNING, "Failed to open streamlink stream for URL \"%s\"! \n%s", c->live_room_url.c_str(), ex.what());
-		return -1;
-	}
-	return 0;
+// Everything needed to resolve a stream, copied so that it can be done off the graphics thread.
+struct resolve_request {
+	std::shared_ptr<streamlink::Session> session;
+	std::string url;
+	std::string definition;
+	// for the writer of a prepared stream; audio only takes streamlink's "audio_only" definition over `definition`
+	// when there is one
+	pipe_filter filter;
+	// empty when the resolution cache is off
+	std::string cache_key;
+	int64_t cache_ttl_s;
+	// seconds into a VOD to start at
+	double start_offset_s;
+	// for "auto (fit)"
+	definition_fit fit;
+	std::shared_ptr<fit_state> fitting;
+	// resolved ahead of time, opened from before asking the plugin; null for none
+	std::shared_ptr<resolved_streams> resolved;
+};
+
+// What decides the streams a URL resolves to: the URL itself, and the options the plugin sees.
+static std::string streamlink_source_cache_key(streamlink_source_t *s)
+{
+	nlohmann::json key = {
+		{"url", s->live_room_url},
+		{"http_proxy", s->session_cfg ? s->session_cfg->http_proxy : ""},
+		{"https_proxy", s->session_cfg ? s->session_cfg->https_proxy : ""},
+		{"options", s->session_cfg ? s->session_cfg->custom_options : ""},
+	};
+	return key.dump();
 }
 
-void streamlink_close(void* opaque) {
-	// TODO error caching
-    auto c = static_cast<streamlink_source_t*>(opaque);
-	streamlink::ThreadGIL state = streamlink::ThreadGIL();
-	if (c->stream) {
-		c->stream->Close();
-		c->stream.reset();
-	}
+// Sources with the same key would end up with the same frames, see `shared_decode`.
+static std::string streamlink_source_share_key(streamlink_source_t *s)
+{
+	// what a timeshifting source shows depends on where it was moved to, a passthrough one decodes nothing
+	if (!s->share_decode || s->timeshift_enabled || s->passthrough || s->live_room_url.empty())
+		return "";
+	const bool fixed = s->downscale == downscale_mode::fixed;
+	nlohmann::json key = {
+		{"stream", streamlink_source_cache_key(s)},
+		{"definition", s->selected_definition},
+		{"media_mode", static_cast<long long>(s->filter.mode)},
+		{"keyframes_only", s->filter.keyframes_only},
+		{"keyframe_interval", s->filter.keyframe_interval_ms},
+		{"hw_decode", s->is_hw_decoding},
+		{"downscale", static_cast<long long>(s->downscale)},
+		{"downscale_width", fixed ? s->downscale_fixed_width : 0},
+		{"downscale_height", fixed ? s->downscale_fixed_height : 0},
+		{"reduce_to_420", s->reduce_to_420.load()},
+		// a recording source needs a writer of its own
+		{"record", s->record},
+		{"serve", s->serve_enabled},
+	};
+	return key.dump();
 }
 
-static void *write_pipe_thread(void *data) {
-	os_set_thread_name("write_thread");
+static definition_fit streamlink_source_fit(struct streamlink_source *s);
+
+static resolve_request streamlink_source_resolve_request(streamlink_source_t *s)
+{
+	return {
+		s->streamlink_session,
+		s->live_room_url,
+		s->selected_definition,
+		s->filter,
+		s->resolution_cache ? streamlink_source_cache_key(s) : "",
+		s->resolution_cache_ttl_min * 60,
+		static_cast<double>(s->vod_start_ms) / 1000.0,
+		s->selected_definition == DEFINITION_AUTO_FIT ? streamlink_source_fit(s) : definition_fit{},
+		s->fitting,
+		nullptr,
+	};
+}
 
-    const auto s = static_cast<streamlink_source_t*>(data);
+// Height and frame rate from names like "720p60" or "1080p_alt", 30 fps when not given. False for "best",
+// "audio_only" and anything else which doesn't tell.
+static bool parse_definition(const std::string &name, uint32_t &height, double &fps)
+{
+	size_t i = 0;
+	while (i < name.size() && std::isdigit(static_cast<unsigned char>(name[i])))
+		i++;
+	if (i == 0 || i > 5 || i >= name.size() || name[i] != 'p')
+		return false;
+	height = static_cast<uint32_t>(std::stoul(name.substr(0, i)));
+	size_t j = i + 1;
+	while (j < name.size() && j - i <= 3 && std::isdigit(static_cast<unsigned char>(name[j])))
+		j++;
+	fps = j > i + 1 ? std::stod(name.substr(i + 1, j - i - 1)) : 30.0;
+	return true;
+}
 
-#ifdef _WIN32
-	auto write_pipe = CreateNamedPipe(
-		s->pipe_path.c_str(),
-		PIPE_ACCESS_OUTBOUND,
-		PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
-		PIPE_UNLIMITED_INSTANCES,
-		0,
-		0,
-		0,
-		nullptr
-	);
-	if (write_pipe == INVALID_HANDLE_VALUE) {
-		std::stringstream msg{};
-		msg << "INVALID_HANDLE_VALUE: " << GetLastError();
-		throw std::runtime_error{msg.str().c_str()};
-	}
-	ConnectNamedPipe(write_pipe, nullptr);
-#else
-	if (mkfifo(s->pipe_path.c_str(), S_IRUSR | S_IWUSR) != 0) {
-		if (errno != EEXIST) {
-			std::stringstream msg{};
-			msg << "mkfifo: " << errno;
-			FF_BLOG(LOG_INFO, "%s", msg.str().c_str());
-			throw std::runtime_error{msg.str().c_str()};
+// The smallest definition at least as tall as `fit` and at least as fast as the canvas, or the smallest one tall
+// enough at the highest frame rate there is, or else "best". Streamlink only tells the resolution through the names
+// plugins give their streams, a 16:9 picture is assumed.
+static std::string pick_fitting_definition(const std::vector<std::string> &names, const definition_fit &fit)
+{
+	if (fit.height == 0)
+		return "best";
+	std::string fitting{}, tall_enough{};
+	uint32_t fitting_height = 0, tall_enough_height = 0;
+	double fitting_fps = 0.0, tall_enough_fps = 0.0;
+	for (const auto &name : names) {
+		uint32_t height;
+		double fps;
+		if (!parse_definition(name, height, fps) || height < fit.height)
+			continue;
+		// 59.94 fps streams are as good as 60 for a 60 fps canvas
+		if (fps + 0.5 >= fit.fps && (fitting.empty() || height < fitting_height ||
+					     (height == fitting_height && fps < fitting_fps))) {
+			fitting = name;
+			fitting_height = height;
+			fitting_fps = fps;
+		}
+		if (tall_enough.empty() || height < tall_enough_height ||
+		    (height == tall_enough_height && fps > tall_enough_fps)) {
+			tall_enough = name;
+			tall_enough_height = height;
+			tall_enough_fps = fps;
 		}
 	}
+	if (!fitting.empty())
+		return fitting;
+	return tall_enough.empty() ? "best" : tall_enough;
+}
 
-	FF_BLOG(LOG_INFO, "opening...");
-	std::ofstream outfife(s->pipe_path, std::iostream::binary);
+// "audio_only" if preferred, or else `definition`, or else "best", or else anything. "auto (fit)" is resolved against
+// what is available and remembered in `fitting`.
+template<typename Map>
+static typename Map::iterator pick_definition(Map &streams, const std::string &definition, bool prefer_audio_only,
+					      const definition_fit &fit, fit_state *fitting)
+{
+	if (prefer_audio_only) {
+		const auto audio = streams.find("audio_only");
+		if (audio != streams.end())
+			return audio;
+	}
+	auto pref = streams.end();
+	if (definition == DEFINITION_AUTO_FIT && fitting) {
+		std::vector<std::string> names{};
+		for (const auto &entry : streams)
+			names.push_back(entry.first);
+		pref = streams.find(pick_fitting_definition(names, fit));
+		std::lock_guard lock{fitting->mutex};
+		fitting->names = std::move(names);
+		fitting->picked = pref != streams.end() ? pref->first : "best";
+	}
+	else
+		pref = streams.find(definition);
+	if (pref == streams.end())
+		pref = streams.find("best");
+	if (pref == streams.end())
+		pref = streams.begin();
+	return pref;
+}
 
-	FF_BLOG(LOG_INFO, "opened?");
-	if (!outfife.is_open()) {
-		std::stringstream msg{};
-		msg << "open outfife: " << errno;
-		FF_BLOG(LOG_INFO, "open outfife: %s", msg.str().c_str());
-		throw std::runtime_error{msg.str().c_str()};
+// What FFmpeg is going to find in the pipe, judging by the kind of stream, so that it doesn't have to guess.
+// Empty when unsure, muxed streams for example come out of streamlink's own FFmpeg as MPEG-TS, but not always.
+static std::string stream_format_hint(streamlink::StreamInfo &info)
+{
+	std::string type, url;
+	try {
+		type = info.Type();
+		url = info.Url();
 	}
-#endif
+	catch (std::exception &) {
+		return "";
+	}
+	if (type == "hls")
+		return "mpegts";
+	if (type != "http")
+		return "";
+	const auto path = url.substr(0, url.find_first_of("?#"));
+	const auto ends_with = [&path](const std::string &ext) {
+		return path.size() >= ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+	};
+	if (ends_with(".flv"))
+		return "flv";
+	if (ends_with(".ts"))
+		return "mpegts";
+	return "";
+}
 
-	FF_BLOG(LOG_INFO, "ready to read and write");
+// Opens the stream remembered for the request, without asking the plugin. Null when there is none or it is stale.
+static std::shared_ptr<streamlink::Stream> streamlink_resolve_cached(const resolve_request &req, std::string &format)
+{
+	auto cached = resolution_cache_get(req.cache_key);
+	if (!cached)
+		return nullptr;
+	const auto pref = pick_definition(*cached, req.definition, req.filter.mode == media_mode::audio_only, req.fit,
+					  req.fitting.get());
+	if (pref == cached->end())
+		return nullptr;
 
-	while (os_event_try(s->stop_signal) == EAGAIN) {
-		std::vector<char> read_buf{};
-		{
-			streamlink::ThreadGIL state = streamlink::ThreadGIL();
-			read_buf = s->stream->Read(1024 * 1024 /* TODO: configurable */);
-		}
+	auto state = streamlink::ThreadGIL();
+	try {
+		auto info = req.session->StreamFromJson(pref->first, pref->second);
+		auto stream = std::make_shared<streamlink::Stream>(info.Open(req.start_offset_s));
+		format = stream_format_hint(info);
+		FF_LOG(LOG_INFO, "Opened cached stream \"%s\" for URL \"%s\"", pref->first.c_str(), req.url.c_str());
+		return stream;
+	}catch (std::exception & ex) {
+		FF_LOG(LOG_INFO, "Cached stream for URL \"%s\" failed to open, resolving again: %s", req.url.c_str(), ex.what());
+		resolution_cache_drop(req.cache_key);
+		return nullptr;
+	}
+}
 
-		if (read_buf.empty()) {
-			FF_BLOG(LOG_INFO, "read: EOF");
-#ifdef _WIN32
-			if (CloseHandle(write_pipe) == FALSE) {
-				std::stringstream msg{};
-				msg << "CloseHandle(pipe_write_handle): " << GetLastError();
-				throw std::runtime_error{msg.str().c_str()};
-			}
-#else
-			outfife.close();
-#endif
-			break;
-		}
+// Whether a stream description sends cookies, authorization or tokens along, which have no place on disk.
+static bool stream_json_has_credentials(const std::string &json)
+{
+	const auto description = nlohmann::json::parse(json, nullptr, false);
+	const auto headers = description.is_object() ? description.find("headers") : description.end();
+	if (headers == description.end() || !headers->is_object())
+		return false;
+	for (const auto &[name, value] : headers->items()) {
+		std::string lower = name;
+		std::transform(lower.begin(), lower.end(), lower.begin(),
+			       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		for (const auto marker : {"auth", "cookie", "token", "secret", "session", "key"})
+			if (lower.find(marker) != std::string::npos)
+				return true;
+	}
+	return false;
+}
 
-#ifdef _WIN32
-		DWORD numWritten;
-		if (WriteFile(write_pipe, read_buf.data(), read_buf.size(), &numWritten, nullptr) == FALSE) {
-			auto ec = GetLastError();
-			FF_BLOG(LOG_INFO, "ec = %lu", ec);
-			if (ec != ERROR_BROKEN_PIPE) {
-				std::stringstream msg{};
-				msg << "WriteFile: " << GetLastError();
-				throw std::runtime_error{msg.str().c_str()};
-			}
-			break;
+// Called with the GIL held.
+static void streamlink_cache_streams(const resolve_request &req, std::map<std::string, streamlink::StreamInfo> &streams)
+{
+	resolution_cache_entry entry{};
+	for (auto &[name, info] : streams) {
+		try {
+			// a plugin's own stream class would come back as a plain one, without what the plugin adds
+			if (!info.Recreatable())
+				continue;
+			auto json = info.ToJson();
+			if (!stream_json_has_credentials(json))
+				entry.emplace(name, std::move(json));
+		}
+		catch (std::exception &) {
+			// streams which can't describe themselves (e.g. muxed ones) are just not cached
 		}
-#else
-		outfife.write(reinterpret_cast<char*>(read_buf.data()), read_buf.size());
-#endif
-		// FF_BLOG(LOG_INFO, "numWritten=%lld", numWritten);
 	}
+	if (!entry.empty())
+		resolution_cache_put(req.cache_key, entry, req.cache_ttl_s);
+}
 
-	{
-		std::error_code ec;
-		std::filesystem::remove(s->pipe_path, ec);
-		(void)ec;
+// Opens one of the streams resolved ahead of time. Null when that fails, what was resolved a while ago may have expired.
+static std::shared_ptr<streamlink::Stream> streamlink_resolve_ahead(const resolve_request &req, std::string &format)
+{
+	auto state = streamlink::ThreadGIL();
+	try {
+		const auto pref = pick_definition(*req.resolved, req.definition, req.filter.mode == media_mode::audio_only,
+						  req.fit, req.fitting.get());
+		if (pref == req.resolved->end())
+			return nullptr;
+		auto stream = std::make_shared<streamlink::Stream>(pref->second.Open(req.start_offset_s));
+		format = stream_format_hint(pref->second);
+		FF_LOG(LOG_INFO, "Opened stream \"%s\" resolved ahead of time for URL \"%s\"", pref->first.c_str(), req.url.c_str());
+		return stream;
+	}
+	catch (std::exception & ex) {
+		FF_LOG(LOG_INFO, "Stream resolved ahead of time for URL \"%s\" failed to open, resolving again: %s",
+		       req.url.c_str(), ex.what());
+		return nullptr;
 	}
-
-	return nullptr;
 }
 
-static void streamlink_source_destroy(void* data);
-
-static void streamlink_source_open(struct streamlink_source *s)
+// Resolves and opens `definition`, or the best one available. Safe to call off the graphics thread.
+static std::shared_ptr<streamlink::Stream> streamlink_resolve(const resolve_request &req, std::string &format)
 {
-	if (!s->live_room_url.empty()) {
-        mp_media_info info = {
-			s,
-			get_frame,
-			preload_frame,
-			seek_frame,
-			get_audio,
-			media_stopped,
-			s->pipe_path.c_str(),
-			nullptr,
-			nullptr,
-			0,
-			100,
-			VIDEO_RANGE_DEFAULT,
-			false,
-			s->is_hw_decoding,
-			false,
-			false,
-		};
-		if (streamlink_open(s) == 0) {
-			if (os_event_init(&s->stop_signal, OS_EVENT_TYPE_MANUAL) != 0) {
-				streamlink_source_destroy(s);
-				return;
-			}
-
-			FF_BLOG(LOG_INFO, ">>>>>>>>>>>>>>>> >>>>>>>>> s->stop_signal initialized");
+	if (req.resolved) {
+		if (auto stream = streamlink_resolve_ahead(req, format))
+			return stream;
+	}
+	if (!req.cache_key.empty()) {
+		if (auto stream = streamlink_resolve_cached(req, format))
+			return stream;
+	}
 
-			if (pthread_create(&s->thread, nullptr, write_pipe_thread, s) != 0) {
-				streamlink_source_destroy(s);
-				return;
-			}
+	auto state = streamlink::ThreadGIL();
+	try {
+		auto streams = req.session->GetStreamsFromUrl(req.url);
+		const auto pref = pick_definition(streams, req.definition, req.filter.mode == media_mode::audio_only, req.fit,
+						  req.fitting.get());
+		if (pref == streams.end()) {
+			FF_LOG(LOG_WARNING, "No streams found for live url %s", req.url.c_str());
+			return nullptr;
+		}
+		if (!req.cache_key.empty())
+			streamlink_cache_streams(req, streams);
+		format = stream_format_hint(pref->second);
+		auto udly = pref->second.Open(req.start_offset_s);
+		return std::make_shared<streamlink::Stream>(udly);
+	}catch (std::exception & ex) {
+		FF_LOG(LOG_WARNING, "Failed to open streamlink stream for URL \"%s\"! \n%s", req.url.c_str(), ex.what());
+		return nullptr;
+	}
+}
 
-			FF_BLOG(LOG_INFO, ">>>>>>>>>>>>>>>> >>>>>>>>> s->write_pipe_thread initialized");
+int streamlink_open(streamlink_source_t* c) {
+	auto req = streamlink_source_resolve_request(c);
+	{
+		std::lock_guard lock{c->prepare_mutex};
+		req.resolved = std::move(c->resolved);
+	}
+	c->stream = streamlink_resolve(req, c->input_format);
+	return c->stream ? 0 : -1;
+}
 
-			s->media_valid = mp_media_init(&s->media, &info);
+void streamlink_close(void* opaque) {
+    auto c = static_cast<streamlink_source_t*>(opaque);
+	streamlink::ThreadGIL state = streamlink::ThreadGIL();
+	if (c->stream) {
+		try {
+			c->stream->Close();
+		}
+		catch (std::exception & ex) {
+			FF_LOG_S(c->source, LOG_WARNING, "Error closing streamlink stream: %s", ex.what());
 		}
-		else s->media_valid = false; // streamlink FAILED
+		c->stream.reset();
 	}
 }
 
-static void streamlink_source_tick(void *data, float seconds)
+static void streamlink_source_stop_writer(streamlink_source_t *s)
 {
-	UNUSED_PARAMETER(seconds);
+	if (!s->writer)
+		return;
+	pipe_writer_stop(s->writer, static_cast<unsigned long>(s->stop_timeout_ms));
+	s->writer.reset();
+}
 
-	const auto s = static_cast<streamlink_source_t*>(data);
-	if (s->destroy_media) {
-		if (s->media_valid) {
-			mp_media_free(&s->media);
-			streamlink_close(s);
-			s->media_valid = false;
-		}
-		s->destroy_media = false;
-	}
+// a fresh path per open, a writer left behind by the previous open may still be holding the old one
+static std::string streamlink_source_next_pipe_path(streamlink_source_t *s)
+{
+	return s->pipe_path + "-" + std::to_string(++s->pipe_generation);
 }
 
-static void streamlink_source_start(struct streamlink_source *s)
+// Opens `definition` next to the running one, the write thread splices it in while media-playback keeps going.
+static bool streamlink_source_switch(streamlink_source_t *s, const std::string &definition)
 {
-	if (!s->media_valid)
-		streamlink_source_open(s);
+	if (!s->writer || !s->streamlink_session)
+		return false;
+	// which definition the audio comes from is up to `pick_definition`
+	if (s->filter.mode == media_mode::audio_only)
+		return false;
+	if (!pipe_writer_switch(s->writer, s->streamlink_session, s->live_room_url, definition))
+		return false;
+	FF_BLOG(LOG_INFO, "switching to definition \"%s\"", definition.c_str());
+	return true;
+}
 
-	if (s->media_valid) {
-		mp_media_play(&s->media, false, false);
+static unsigned long streamlink_source_read_interval(streamlink_source_t *s)
+{
+	return static_cast<unsigned long>(std::max(10LL, s->stop_timeout_ms / 2));
+}
+
+// Drops whatever was prepared. A prepare still running is not waited for, it throws its result away once done.
+static void streamlink_source_release_prepared(streamlink_source_t *s, const char *reason)
+{
+	std::shared_ptr<pipe_writer> prepared;
+	std::shared_ptr<resolved_streams> resolved;
+	{
+		std::lock_guard lock{s->prepare_mutex};
+		s->prepare_generation++;
+		s->prepare_queued = false;
+		prepared = std::move(s->prepared);
+		resolved = std::move(s->resolved);
 	}
+	if (!prepared)
+		return;
+	FF_BLOG(LOG_INFO, "releasing prewarmed stream: %s", reason);
+	pipe_writer_stop(prepared, static_cast<unsigned long>(s->stop_timeout_ms));
 }
 
-static void streamlink_source_update(void *data, obs_data_t *settings)
+// Offers what this source is about to decode to the others with the same share key.
+static void streamlink_source_own_share(streamlink_source_t *s)
 {
-	const auto s = static_cast<streamlink_source_t*>(data);
+	if (s->share_key.empty() || s->shared)
+		return;
+	auto shared = shared_decode_own(s->share_key);
+	std::lock_guard lock{s->share_mutex};
+	s->shared = std::move(shared);
+}
 
-	update_streamlink_session(s, settings);
+// Stops handing frames to other sources. They open the stream themselves if `handover`, otherwise it failed for
+// them as well.
+static void streamlink_source_end_share(streamlink_source_t *s, bool handover)
+{
+	std::shared_ptr<shared_decode> shared;
+	{
+		std::lock_guard lock{s->share_mutex};
+		shared = std::move(s->shared);
+	}
+	if (shared)
+		shared_decode_end(shared, handover);
+}
 
-	const auto live_room_url = obs_data_get_string(settings, URL);
-	s->live_room_url = live_room_url ? std::string{live_room_url} : std::string{};
+static bool streamlink_source_has_subscribers(streamlink_source_t *s)
+{
+	std::lock_guard lock{s->share_mutex};
+	return s->shared && !shared_decode_subscribers(s->shared).empty();
+}
+
+// Shows what another source already decodes, instead of fetching and decoding the same stream again.
+static bool streamlink_source_join_share(streamlink_source_t *s)
+{
+	if (s->share_key.empty())
+		return false;
+	s->subscribed = shared_decode_join(s->share_key, s->source);
+	if (!s->subscribed)
+		return false;
+	streamlink_source_release_prepared(s, "sharing the decoder of another source");
+	load_batch_leave(s, false);
+	FF_BLOG(LOG_INFO, "sharing the decoder of another source");
+	return true;
+}
 
-	s->is_hw_decoding = obs_data_get_bool(settings, HW_DECODE);
+static void streamlink_source_leave_share(streamlink_source_t *s)
+{
+	if (!s->subscribed)
+		return;
+	shared_decode_leave(s->subscribed, s->source);
+	s->subscribed.reset();
+}
 
+// Stops playback and tears the whole transport down, within `stop_timeout_ms` even if streamlink is stuck.
+static void streamlink_source_close(streamlink_source_t *s)
+{
+	streamlink_source_leave_share(s);
+	streamlink_source_release_prepared(s, "closed");
+	{
+		std::lock_guard lock{s->seek_mutex};
+		s->seek_pipe_path.clear();
+	}
+	streamlink_source_stop_writer(s);
 	if (s->media_valid) {
 		mp_media_free(&s->media);
-		streamlink_close(s);
 		s->media_valid = false;
 	}
-	bool active = obs_source_active(s->source);
+	streamlink_source_end_share(s, true);
+	streamlink_close(s);
+}
 
-	if (active)
-		streamlink_source_start(s);
+// A probe budget which is plenty when the format is known and the input starts at a keyframe, instead of the
+// 5 MB / 5 s FFmpeg spends by default on finding out what a pipe carries.
+static std::string probe_options_for(const std::string &format)
+{
+	if (format == "mpegts")
+		return "probesize=1048576 analyzeduration=1000000";
+	if (format == "flv")
+		return "probesize=262144 analyzeduration=1000000";
+	return "";
 }
 
-static const char *streamlink_source_getname(void *unused)
+static std::shared_ptr<http_server> streamlink_source_serving(struct streamlink_source *s)
 {
-	UNUSED_PARAMETER(unused);
-	return obs_module_text("StreamlinkSource");
+	std::lock_guard lock{s->serve_mutex};
+	return s->serving;
 }
 
-static void restart_hotkey(void *data, obs_hotkey_id id, obs_hotkey_t *hotkey,
-			   bool pressed)
+static std::shared_ptr<replay_buffer> streamlink_source_replay(struct streamlink_source *s)
 {
-	UNUSED_PARAMETER(id);
-	UNUSED_PARAMETER(hotkey);
-	UNUSED_PARAMETER(pressed);
+	std::lock_guard lock{s->replay_mutex};
+	return s->replay;
+}
 
-	const auto s = static_cast<streamlink_source_t*>(data);
-	if (obs_source_active(s->source))
-		streamlink_source_start(s);
+static void streamlink_source_init_media(struct streamlink_source *s, const std::string &pipe_path)
+{
+	s->open_ts = os_gettime_ns();
+	s->media_received = false;
+	s->vod_frame_seen = false;
+	s->vod_played_ms = 0;
+	s->frames_sampled = s->frames_decoded;
+	s->decode_cpu_ns_sampled = 0;
+	const bool hinted = !s->full_probe && !s->input_format.empty();
+	auto probe_options = hinted ? probe_options_for(s->input_format) : "";
+	if (hinted)
+		FF_BLOG(LOG_INFO, "opening as \"%s\" with %s", s->input_format.c_str(), probe_options.c_str());
+	mp_media_info info = {
+		s,
+		get_frame,
+		preload_frame,
+		seek_frame,
+		get_audio,
+		media_stopped,
+		pipe_path.c_str(),
+		hinted ? s->input_format.c_str() : nullptr,
+		probe_options.empty() ? nullptr : probe_options.data(),
+		0,
+		100,
+		VIDEO_RANGE_DEFAULT,
+		false,
+		s->is_hw_decoding,
+		false,
+		false,
+	};
+	s->media_valid = mp_media_init(&s->media, &info);
+	if (!s->media_valid)
+		streamlink_source_close(s);
 }
 
-static void *streamlink_source_create(obs_data_t *settings, obs_source_t *source)
+static void streamlink_source_open(struct streamlink_source *s)
 {
-	const auto s = static_cast<streamlink_source_t*>(bzalloc(sizeof(streamlink_source)));
+	if (!s->live_room_url.empty()) {
+		if (streamlink_open(s) != 0) {
+			s->media_valid = false; // streamlink FAILED
+			return;
+		}
 
-	s->source = source;
-	s->available_definitions = std::vector<std::string>{};
+		if (s->passthrough) {
+			s->writer = pipe_writer_start_relay(s->stream, obs_source_get_name(s->source),
+							    streamlink_source_read_interval(s));
+			if (!s->writer) {
+				FF_BLOG(LOG_WARNING, "Failed to start the write thread");
+				streamlink_close(s);
+				return;
+			}
+			s->vod_checked = false;
+			pipe_writer_record(s->writer, s->recording);
+			pipe_writer_replay(s->writer, streamlink_source_replay(s));
+			pipe_writer_serve(s->writer, streamlink_source_serving(s));
+			pipe_writer_limit(s->writer, s->bandwidth);
+			FF_BLOG(LOG_INFO, "passing the stream through without decoding");
+			return;
+		}
+
+		const auto pipe_path = streamlink_source_next_pipe_path(s);
+		auto shift = s->timeshift_enabled
+				     ? timeshift_create(static_cast<size_t>(s->timeshift_memory_mb) * 1024 * 1024,
+							static_cast<uint32_t>(s->timeshift_window_min * 60))
+				     : nullptr;
+		if (s->timeshift_enabled && !shift) {
+			FF_BLOG(LOG_WARNING, "timeshift: failed to allocate %lld MiB, lower its memory limit",
+				s->timeshift_memory_mb);
+			streamlink_close(s);
+			return;
+		}
+		s->writer = pipe_writer_start(s->stream, pipe_path, obs_source_get_name(s->source),
+					      streamlink_source_read_interval(s), s->filter, s->start_at_keyframe,
+					      std::move(shift));
+		if (!s->writer) {
+			FF_BLOG(LOG_WARNING, "Failed to start the write thread");
+			streamlink_close(s);
+			return;
+		}
+		s->vod_checked = false;
+		pipe_writer_record(s->writer, s->recording);
+		pipe_writer_replay(s->writer, streamlink_source_replay(s));
+		pipe_writer_serve(s->writer, streamlink_source_serving(s));
+		pipe_writer_limit(s->writer, s->bandwidth);
+		streamlink_source_own_share(s);
+		streamlink_source_init_media(s, pipe_path);
+	}
+}
+
+// Leaves the stream running without decoding, see `pipe_writer_keep_warm`.
+static void streamlink_source_keep_warm(struct streamlink_source *s)
+{
+	pipe_writer_keep_warm(s->writer, static_cast<size_t>(s->warm_buffer_limit_mb) * 1024 * 1024);
+	// cleared first, so `media_stopped` doesn't schedule a full close
+	s->media_valid = false;
+	mp_media_free(&s->media);
+	streamlink_source_end_share(s, true);
+	FF_BLOG(LOG_INFO, "keeping warm while hidden");
+}
+
+// Picks a stream kept warm back up with a fresh decoder, which starts right at the kept keyframe.
+static void streamlink_source_resume(struct streamlink_source *s)
+{
+	const auto pipe_path = streamlink_source_next_pipe_path(s);
+	if (!pipe_writer_resume(s->writer, pipe_path)) {
+		streamlink_source_close(s);
+		streamlink_source_open(s);
+		return;
+	}
+	streamlink_source_own_share(s);
+	streamlink_source_init_media(s, pipe_path);
+}
+
+// Resolves and opens the stream without decoding it, so that showing the source doesn't wait for the network.
+// Runs on the worker pool, the result is picked up by the next `streamlink_source_start`.
+static void streamlink_source_prepare_stream(struct streamlink_source *s, const resolve_request &req,
+					     unsigned long generation)
+{
+	const uint64_t start_ts = os_gettime_ns();
+	std::string format{};
+	auto stream = streamlink_resolve(req, format);
+	if (!stream)
+		return;
+	auto prepared = pipe_writer_start_warm(stream, obs_source_get_name(s->source), streamlink_source_read_interval(s),
+					       req.filter,
+					       static_cast<size_t>(s->warm_buffer_limit_mb) * 1024 * 1024);
+	if (!prepared) {
+		streamlink::ThreadGIL state = streamlink::ThreadGIL();
+		try {
+			stream->Close();
+		}
+		catch (std::exception &) {
+		}
+		return;
+	}
+	pipe_writer_limit(prepared, s->bandwidth);
+
+	std::shared_ptr<resolved_streams> resolved;
+	bool stale;
+	{
+		std::lock_guard lock{s->prepare_mutex};
+		stale = generation != s->prepare_generation;
+		if (!stale) {
+			std::swap(s->prepared, prepared);
+			s->prepared_format = format;
+			s->prepared_ts = os_gettime_ns();
+			resolved = std::move(s->resolved);
+		}
+	}
+	// lost a race against another prepare, or the source changed meanwhile
+	if (prepared)
+		pipe_writer_stop(prepared, static_cast<unsigned long>(s->stop_timeout_ms));
+	if (!stale)
+		FF_BLOG(LOG_INFO, "prewarmed in %.0f ms", static_cast<double>(os_gettime_ns() - start_ts) / 1000000.0);
+}
+
+// Only asks the plugin which streams there are, without opening any, so that loading a scene collection doesn't
+// fetch what may never be shown. The next open within the prewarm timeout picks from them.
+static void streamlink_source_resolve_ahead(struct streamlink_source *s, const resolve_request &req,
+					    unsigned long generation)
+{
+	const uint64_t start_ts = os_gettime_ns();
+	std::shared_ptr<resolved_streams> resolved;
+	{
+		auto state = streamlink::ThreadGIL();
+		try {
+			resolved = std::make_shared<resolved_streams>(req.session->GetStreamsFromUrl(req.url));
+			if (!req.cache_key.empty())
+				streamlink_cache_streams(req, *resolved);
+		}
+		catch (std::exception & ex) {
+			FF_BLOG(LOG_WARNING, "Failed to resolve URL \"%s\" ahead of time: %s", req.url.c_str(), ex.what());
+			return;
+		}
+	}
+	if (resolved->empty())
+		return;
+	bool stale;
+	{
+		std::lock_guard lock{s->prepare_mutex};
+		stale = generation != s->prepare_generation;
+		if (!stale) {
+			std::swap(s->resolved, resolved);
+			s->prepared_ts = os_gettime_ns();
+		}
+	}
+	if (!stale)
+		FF_BLOG(LOG_INFO, "resolved ahead of time in %.0f ms", static_cast<double>(os_gettime_ns() - start_ts) / 1000000.0);
+}
+
+static bool streamlink_source_can_prepare(struct streamlink_source *s)
+{
+	// a prepared writer has no timeshift to take over, and a passthrough source opens right away anyway
+	return !s->media_valid && !s->writer && !s->live_room_url.empty() && s->streamlink_session && !s->timeshift_enabled &&
+	       !s->passthrough;
+}
+
+// Prepares on the worker pool, so that many sources resolve at once: opens the stream if `open`, or else only
+// resolves it. Called on the graphics thread, which owns everything the request is copied from.
+static bool streamlink_source_queue_prepare(struct streamlink_source *s, bool open)
+{
+	if (!streamlink_source_can_prepare(s))
+		return false;
+	unsigned long generation;
+	{
+		std::lock_guard lock{s->prepare_mutex};
+		if (s->prepared || s->prepare_queued || (s->resolved && !open)) {
+			// asked for again, the prewarm timeout starts over
+			s->prepared_ts = os_gettime_ns();
+			return false;
+		}
+		s->prepare_queued = true;
+		s->prepare_running++;
+		generation = s->prepare_generation;
+	}
+	// copied now, `streamlink_source_update` may change them while the task waits
+	worker_pool_submit([s, req = streamlink_source_resolve_request(s), open, generation] {
+		if (open)
+			streamlink_source_prepare_stream(s, req, generation);
+		else
+			streamlink_source_resolve_ahead(s, req, generation);
+		std::lock_guard lock{s->prepare_mutex};
+		if (generation == s->prepare_generation) {
+			s->prepare_queued = false;
+			if (!s->prepared && !s->resolved)
+				load_batch_leave(s, false);
+		}
+		s->prepare_running--;
+		s->prepare_cv.notify_all();
+	});
+	return true;
+}
+
+static bool streamlink_source_preparing(struct streamlink_source *s)
+{
+	std::lock_guard lock{s->prepare_mutex};
+	return s->prepare_queued;
+}
+
+// Prepares still running hold on to the source, which can only go once they are done.
+static void streamlink_source_wait_prepared(struct streamlink_source *s)
+{
+	std::unique_lock lock{s->prepare_mutex};
+	s->prepare_cv.wait(lock, [s] { return s->prepare_running == 0; });
+}
+
+static bool streamlink_source_adopt_prepared(struct streamlink_source *s)
+{
+	std::shared_ptr<pipe_writer> prepared;
+	{
+		std::lock_guard lock{s->prepare_mutex};
+		prepared = std::move(s->prepared);
+		if (prepared)
+			s->input_format = s->prepared_format;
+	}
+	if (!prepared)
+		return false;
+	{
+		std::lock_guard lock{prepared->stream_mutex};
+		s->stream = prepared->stream;
+	}
+	s->writer = std::move(prepared);
+	s->vod_checked = false;
+	pipe_writer_record(s->writer, s->recording);
+	pipe_writer_replay(s->writer, streamlink_source_replay(s));
+	pipe_writer_serve(s->writer, streamlink_source_serving(s));
+	pipe_writer_limit(s->writer, s->bandwidth);
+	return true;
+}
+
+static void streamlink_source_expire_prepared(struct streamlink_source *s)
+{
+	{
+		std::lock_guard lock{s->prepare_mutex};
+		if ((!s->prepared && !s->resolved) ||
+		    os_gettime_ns() - s->prepared_ts < static_cast<uint64_t>(s->prewarm_timeout_s) * 1000000000ULL)
+			return;
+	}
+	streamlink_source_release_prepared(s, "not shown in time");
+	load_batch_leave(s, false);
+}
+
+struct displayed_size {
+	const obs_source_t *source;
+	uint32_t width;
+	uint32_t height;
+	// an item shown at the source's own size, scaling the source would shrink it on the canvas
+	bool unbounded;
+};
+
+static bool find_displayed_size(obs_scene_t *scene, obs_sceneitem_t *item, void *param)
+{
+	UNUSED_PARAMETER(scene);
+	const auto size = static_cast<displayed_size*>(param);
+	if (obs_sceneitem_is_group(item)) {
+		obs_sceneitem_group_enum_items(item, find_displayed_size, param);
+		return true;
+	}
+	if (obs_sceneitem_get_source(item) != size->source || !obs_sceneitem_visible(item))
+		return true;
+	if (obs_sceneitem_get_bounds_type(item) == OBS_BOUNDS_NONE) {
+		size->unbounded = true;
+		return true;
+	}
+	vec2 bounds{};
+	obs_sceneitem_get_bounds(item, &bounds);
+	size->width = std::max(size->width, static_cast<uint32_t>(std::ceil(bounds.x)));
+	size->height = std::max(size->height, static_cast<uint32_t>(std::ceil(bounds.y)));
+	return true;
+}
+
+static bool find_displayed_size_in_scene(void *param, obs_source_t *scene_source)
+{
+	if (obs_scene_t *scene = obs_scene_from_source(scene_source))
+		obs_scene_enum_items(scene, find_displayed_size, param);
+	return true;
+}
+
+// The largest bounding box this source, or any source sharing its decoder, is shown in across all scenes.
+static displayed_size streamlink_source_displayed_size(struct streamlink_source *s)
+{
+	// frames handed to other sources have to fit wherever those are shown too
+	std::vector<obs_source_t*> sources{s->source};
+	{
+		std::lock_guard lock{s->share_mutex};
+		if (s->shared)
+			for (const auto subscriber : shared_decode_subscribers(s->shared))
+				sources.push_back(subscriber);
+	}
+	displayed_size size{s->source, 0, 0, false};
+	for (const auto source : sources) {
+		size.source = source;
+		obs_enum_scenes(find_displayed_size_in_scene, &size);
+	}
+	return size;
+}
+
+// Only bounding boxes count: an item without one is sized by the source itself, so any such item turns scaling off.
+static void streamlink_source_update_max_size(struct streamlink_source *s)
+{
+	switch (s->downscale) {
+	case downscale_mode::off:
+		s->max_width = 0;
+		s->max_height = 0;
+		break;
+	case downscale_mode::fixed:
+		s->max_width = s->downscale_fixed_width;
+		s->max_height = s->downscale_fixed_height;
+		break;
+	case downscale_mode::displayed: {
+		const auto size = streamlink_source_displayed_size(s);
+		const bool scale = !size.unbounded && size.width > 0 && size.height > 0;
+		s->max_width = scale ? size.width : 0;
+		s->max_height = scale ? size.height : 0;
+		break;
+	}
+	}
+}
+
+// The height to cover is that of a 16:9 picture filling the box either way. Unknown when an item has no bounding box,
+// it is sized by the source itself then and would shrink along with the definition.
+static definition_fit streamlink_source_fit(struct streamlink_source *s)
+{
+	obs_video_info ovi{};
+	const double fps = obs_get_video_info(&ovi) && ovi.fps_den > 0
+				   ? static_cast<double>(ovi.fps_num) / static_cast<double>(ovi.fps_den)
+				   : 30.0;
+	const auto size = streamlink_source_displayed_size(s);
+	if (size.unbounded || size.width == 0 || size.height == 0)
+		return {0, fps};
+	const auto height = static_cast<uint32_t>(std::ceil(static_cast<double>(size.width) * 9.0 / 16.0));
+	return {std::max(size.height, height), fps};
+}
+
+// Picks again for "auto (fit)" once a second, and moves to another definition when where the source is shown asks
+// for one for `FIT_SETTLE` looks in a row.
+static void streamlink_source_refit(struct streamlink_source *s, float seconds)
+{
+	if (s->selected_definition != DEFINITION_AUTO_FIT)
+		return;
+	s->fit_elapsed += seconds;
+	if (s->fit_elapsed < 1.0f)
+		return;
+	s->fit_elapsed = 0.0f;
+	s->fit = streamlink_source_fit(s);
+	if (!s->media_valid || !s->writer)
+		return;
+
+	std::string picked, current;
+	{
+		std::lock_guard lock{s->fitting->mutex};
+		if (s->fitting->names.empty())
+			return;
+		picked = pick_fitting_definition(s->fitting->names, s->fit);
+		current = s->fitting->picked;
+	}
+	if (picked == current) {
+		s->fit_pending_looks = 0;
+		return;
+	}
+	if (picked != s->fit_pending) {
+		s->fit_pending = picked;
+		s->fit_pending_looks = 0;
+	}
+	if (++s->fit_pending_looks < FIT_SETTLE)
+		return;
+	s->fit_pending_looks = 0;
+
+	FF_BLOG(LOG_INFO, "auto (fit): %u px at %.2f fps is best served by \"%s\"", s->fit.height, s->fit.fps,
+		picked.c_str());
+	if (s->seamless_switch && streamlink_source_switch(s, picked)) {
+		std::lock_guard lock{s->fitting->mutex};
+		s->fitting->picked = picked;
+		return;
+	}
+	streamlink_source_close(s);
+	streamlink_source_start(s);
+}
+
+// CPU time spent by the media thread, which demuxes and decodes, 0 where that can't be told. FFmpeg's own decoder
+// threads are not in it.
+static uint64_t streamlink_source_decode_cpu_ns(struct streamlink_source *s)
+{
+#ifdef __linux__
+	clockid_t clock;
+	timespec ts{};
+	if (!s->media_valid || !s->media.thread_valid || pthread_getcpuclockid(s->media.thread, &clock) != 0 ||
+	    clock_gettime(clock, &ts) != 0)
+		return 0;
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+#else
+	UNUSED_PARAMETER(s);
+	return 0;
+#endif
+}
+
+// Measures how much this source decodes, and tells the bandwidth limit how it is watched.
+static void streamlink_source_sample_decode(struct streamlink_source *s, float seconds)
+{
+	s->decode_sample_elapsed += seconds;
+	if (s->decode_sample_elapsed < 1.0f)
+		return;
+
+	const uint64_t frames = s->frames_decoded;
+	const uint64_t cpu_ns = streamlink_source_decode_cpu_ns(s);
+	s->decode_fps = static_cast<double>(frames - s->frames_sampled) / s->decode_sample_elapsed;
+	s->decode_ms_per_s = s->decode_cpu_ns_sampled && cpu_ns >= s->decode_cpu_ns_sampled
+				     ? static_cast<double>(cpu_ns - s->decode_cpu_ns_sampled) / 1000000.0 / s->decode_sample_elapsed
+				     : 0.0;
+	s->frames_sampled = frames;
+	s->decode_cpu_ns_sampled = cpu_ns;
+	s->decode_sample_elapsed = 0.0f;
+	if (s->downscale == downscale_mode::displayed)
+		streamlink_source_update_max_size(s);
+
+	const uint64_t converted = s->frames_converted.exchange(0);
+	const uint64_t convert_ns = s->convert_ns.exchange(0);
+	s->convert_ms = converted ? static_cast<double>(convert_ns) / 1000000.0 / static_cast<double>(converted) : 0.0;
+
+	source_tier tier = source_tier::hidden;
+	if (s->media_valid) {
+		bool active = obs_source_active(s->source);
+		std::lock_guard lock{s->share_mutex};
+		if (s->shared)
+			for (const auto subscriber : shared_decode_subscribers(s->shared))
+				active = active || obs_source_active(subscriber);
+		tier = active ? source_tier::program : source_tier::preview;
+	}
+	// what a passthrough source reads is still watched live, only elsewhere
+	s->bandwidth->tier = s->passthrough ? std::max(tier, source_tier::preview) : tier;
+}
+
+// Streamlink keeps fetching into the ring buffer while the bandwidth limit holds reads back, the network only slows
+// down once it is full. Bounded to a few seconds at the enforced rate, that happens right away.
+static size_t streamlink_source_limited_buffer(struct streamlink_source *s, size_t size)
+{
+	const uint64_t rate = s->bandwidth->rate;
+	if (rate == 0)
+		return size;
+	const auto bytes = static_cast<size_t>(static_cast<double>(rate) * RING_BUFFER_LIMITED_S);
+	// whole MiB, like automatic sizes
+	const size_t bound = (bytes + 1024 * 1024 - 1) / (1024 * 1024) * (1024 * 1024);
+	return std::min(size, std::max(bound, BUFFER_BUDGET_MIN));
+}
+
+// Tells the buffer budget what the ring buffer of the running stream takes. With automatic sizing, the writer resizes
+// it to hold `ring_buffer_seconds` of the input measured meanwhile, as far as the budget allows. Either way, it is
+// bounded while the bandwidth limit applies.
+static void streamlink_source_size_buffer(struct streamlink_source *s, float seconds)
+{
+	const uint64_t bytes = s->bandwidth->bytes_read;
+	if (!s->writer) {
+		buffer_budget_remove(s);
+		s->input_sample_elapsed = 0.0f;
+		s->input_bytes_sampled = bytes;
+		return;
+	}
+	const size_t fixed = s->session_cfg && s->session_cfg->ringbuffer_size > 0
+				     ? static_cast<size_t>(s->session_cfg->ringbuffer_size) * 1024 * 1024
+				     : RING_BUFFER_DEFAULT;
+	// counted at the size it was opened with until measured
+	if (buffer_budget_size(s) == 0)
+		buffer_budget_update(s, fixed, true);
+	s->input_sample_elapsed += seconds;
+	if (s->input_sample_elapsed < INPUT_SAMPLE_S)
+		return;
+
+	const double rate = static_cast<double>(bytes - s->input_bytes_sampled) / s->input_sample_elapsed;
+	s->input_bytes_sampled = bytes;
+	s->input_sample_elapsed = 0.0f;
+	// bursts count right away, quiet stretches are forgotten slowly
+	s->input_bytes_per_s = std::max(rate, s->input_bytes_per_s * 0.75);
+	if (!s->ring_buffer_auto) {
+		buffer_budget_update(s, fixed, true);
+		const size_t limited = streamlink_source_limited_buffer(s, fixed);
+		if (s->writer->buffer_target || limited != fixed)
+			s->writer->buffer_target = limited;
+		return;
+	}
+	if (s->input_bytes_per_s <= 0.0)
+		return;
+
+	const auto wanted = static_cast<size_t>(s->input_bytes_per_s * static_cast<double>(s->ring_buffer_seconds));
+	buffer_budget_update(s, std::clamp(wanted, BUFFER_BUDGET_MIN, RING_BUFFER_AUTO_MAX), false);
+	// whole MiB, and only when it moved by a quarter, so that the bitrate wobbling doesn't resize all the time
+	const size_t granted = streamlink_source_limited_buffer(
+		s, (buffer_budget_size(s) + 1024 * 1024 - 1) / (1024 * 1024) * (1024 * 1024));
+	const size_t current = s->writer->buffer_target ? s->writer->buffer_target.load() : fixed;
+	if (granted * 4 < current * 3 || granted * 4 > current * 5)
+		s->writer->buffer_target = granted;
+}
+
+// Hands the tuned HLS settings to the session, streamlink reads them when the next stream is opened.
+static void streamlink_source_apply_hls(struct streamlink_source *s)
+{
+	if (!s->streamlink_session)
+		return;
+	streamlink::ThreadGIL state = streamlink::ThreadGIL();
+	try {
+		s->streamlink_session->SetOptionInt("hls-live-edge", s->hls_live_edge);
+		s->streamlink_session->SetOptionInt("hls-segment-threads", s->hls_segment_threads);
+	}
+	catch (std::exception &ex) {
+		FF_BLOG(LOG_WARNING, "Failed to apply tuned HLS settings: %s", ex.what());
+	}
+}
+
+// Replaces the playing stream with one opened with the tuned settings, seamlessly where switching can. Passthrough
+// keeps its stream until it is reopened anyway.
+static void streamlink_source_reopen_hls(struct streamlink_source *s)
+{
+	if (!s->media_valid)
+		return;
+	std::string definition = s->selected_definition;
+	if (definition == DEFINITION_AUTO_FIT) {
+		std::lock_guard lock{s->fitting->mutex};
+		definition = s->fitting->picked;
+	}
+	if (s->seamless_switch && !definition.empty() && streamlink_source_switch(s, definition))
+		return;
+	streamlink_source_close(s);
+	streamlink_source_start(s);
+}
+
+// Tunes live edge and segment threads by how long segments take to download against how long they play. When that
+// leaves little slack, live edge goes up to cover the slowest segment with one to spare, and one more segment is
+// fetched at once, unless the bandwidth limit paces the fetches anyway. A stall raises both by one. Once segments
+// arrive quickly for a couple of minutes, both come down by one for less latency.
+static void streamlink_source_tune_hls(struct streamlink_source *s, float seconds)
+{
+	if (!s->hls_auto || !s->writer || s->vod_duration_ms > 0) {
+		s->hls_tune_elapsed = 0.0f;
+		return;
+	}
+	s->hls_tune_elapsed += seconds;
+	if (s->hls_tune_elapsed < HLS_TUNE_INTERVAL_S)
+		return;
+	s->hls_tune_elapsed = 0.0f;
+
+	unsigned segments;
+	double load, worst;
+	{
+		std::lock_guard lock{s->hls_timing->mutex};
+		segments = s->hls_timing->segments;
+		load = s->hls_timing->duration_s > 0.0 ? s->hls_timing->download_s / s->hls_timing->duration_s : 0.0;
+		worst = s->hls_timing->worst;
+		s->hls_timing->segments = 0;
+		s->hls_timing->download_s = 0.0;
+		s->hls_timing->duration_s = 0.0;
+		s->hls_timing->worst = 0.0;
+	}
+	const bool measured = segments >= HLS_TUNE_MIN_SEGMENTS;
+	const unsigned stalls = s->writer->stalls.exchange(0);
+	const bool limited = s->bandwidth->rate > 0;
+	long long live_edge = s->hls_live_edge;
+	long long threads = s->hls_segment_threads;
+	if (stalls > 0) {
+		s->hls_stalls += stalls;
+		s->hls_calm = -HLS_TUNE_HOLDOFF;
+		live_edge = std::min(live_edge + 1, 20LL);
+		if (!limited)
+			threads = std::min(threads + 1, 10LL);
+	}
+	else if (measured && load > HLS_LOAD_HIGH) {
+		s->hls_calm = std::min(s->hls_calm, 0);
+		const auto needed = static_cast<long long>(std::ceil(worst)) + 1;
+		if (live_edge < needed) {
+			live_edge = std::min(needed, 20LL);
+			if (!limited)
+				threads = std::min(threads + 1, 10LL);
+		}
+	}
+	else if (measured && load < HLS_LOAD_CALM && worst < HLS_LOAD_HIGH) {
+		if (++s->hls_calm >= HLS_TUNE_CALM) {
+			s->hls_calm = 0;
+			live_edge = std::max(live_edge - 1, 1LL);
+			threads = std::max(threads - 1, 1LL);
+		}
+	}
+	else
+		s->hls_calm = std::min(s->hls_calm, 0);
+	if (live_edge == s->hls_live_edge && threads == s->hls_segment_threads)
+		return;
+
+	FF_BLOG(LOG_INFO, "HLS tuning: live edge %lld, %lld segment thread(s); %u segments took %.0f%% of their length "
+			  "to download, %.0f%% at worst%s",
+		live_edge, threads, segments, load * 100.0, worst * 100.0, stalls > 0 ? ", stalled" : "");
+	s->hls_live_edge = live_edge;
+	s->hls_segment_threads = threads;
+	streamlink_source_apply_hls(s);
+	streamlink_source_reopen_hls(s);
+}
+
+// Takes the segment index over from the writer, once it found out whether the stream is a VOD.
+static void streamlink_source_index_vod(struct streamlink_source *s)
+{
+	if (s->vod_checked || !s->writer || !s->writer->vod_indexed)
+		return;
+	s->vod_checked = true;
+	std::vector<double> segments;
+	{
+		std::lock_guard lock{s->writer->vod_mutex};
+		segments = s->writer->vod_segments;
+	}
+	if (segments.empty())
+		return;
+	std::vector<int64_t> starts_ms{};
+	starts_ms.reserve(segments.size());
+	double total_s = 0.0;
+	for (const double duration : segments) {
+		starts_ms.push_back(std::llround(total_s * 1000.0));
+		total_s += duration;
+	}
+	std::lock_guard lock{s->vod_mutex};
+	s->vod_segment_starts_ms = std::move(starts_ms);
+	s->vod_duration_ms = std::llround(total_s * 1000.0);
+}
+
+static void streamlink_source_reset_vod(struct streamlink_source *s)
+{
+	std::lock_guard lock{s->vod_mutex};
+	s->vod_segment_starts_ms.clear();
+	s->vod_duration_ms = 0;
+	s->vod_start_ms = 0;
+}
+
+static void streamlink_source_stop_showing(struct streamlink_source *s);
+static void streamlink_source_retry_serve(struct streamlink_source *s);
+static void streamlink_source_finish_seek(struct streamlink_source *s);
+
+static void streamlink_source_tick(void *data, float seconds)
+{
+	const auto s = static_cast<streamlink_source_t*>(data);
+	streamlink_source_sample_decode(s, seconds);
+	streamlink_source_size_buffer(s, seconds);
+	streamlink_source_tune_hls(s, seconds);
+	streamlink_source_refit(s, seconds);
+	streamlink_source_index_vod(s);
+	streamlink_source_retry_serve(s);
+	streamlink_source_finish_seek(s);
+	if (s->subscribed && s->subscribed->ended) {
+		const bool handover = s->subscribed->handover;
+		streamlink_source_leave_share(s);
+		if (handover && obs_source_showing(s->source))
+			streamlink_source_start(s);
+	}
+	if (s->kept_for_subscribers && !obs_source_showing(s->source) && !streamlink_source_has_subscribers(s)) {
+		s->kept_for_subscribers = false;
+		streamlink_source_stop_showing(s);
+	}
+	if (s->destroy_media) {
+		if (s->media_valid) {
+			// the stream failed, unless it is only reopened with full probing
+			streamlink_source_end_share(s, s->reopen_media);
+			streamlink_source_close(s);
+		}
+		s->destroy_media = false;
+		if (s->reopen_media && obs_source_showing(s->source))
+			streamlink_source_start(s);
+		s->reopen_media = false;
+	}
+	// nothing else notices a passthrough stream ending, there is no decoder to stop
+	if (s->passthrough && s->writer && os_event_try(s->writer->exited_signal) == 0) {
+		FF_BLOG(LOG_INFO, "passthrough stream ended");
+		streamlink_source_close(s);
+	}
+	if (s->writer && s->writer->restart_requested) {
+		streamlink_source_close(s);
+		if (obs_source_showing(s->source))
+			streamlink_source_start(s);
+	}
+	if (s->prepare_requested.exchange(false))
+		streamlink_source_queue_prepare(s, true);
+	if (s->start_deferred && !streamlink_source_preparing(s)) {
+		s->start_deferred = false;
+		if (obs_source_showing(s->source))
+			streamlink_source_start(s);
+	}
+	streamlink_source_expire_prepared(s);
+}
+
+// Whether anything takes what a passthrough source reads, it would fetch the stream for nothing otherwise.
+static bool streamlink_source_passthrough_used(struct streamlink_source *s)
+{
+	return s->recording || streamlink_source_replay(s) || s->serve_enabled;
+}
+
+static void streamlink_source_start(struct streamlink_source *s)
+{
+	if (s->passthrough) {
+		if (s->writer)
+			return;
+		if (!streamlink_source_passthrough_used(s)) {
+			FF_BLOG(LOG_WARNING, "passthrough: recording, the replay buffer and serving are all off, not fetching the stream");
+			return;
+		}
+		streamlink_source_open(s);
+		return;
+	}
+	if (s->subscribed)
+		return;
+	if (!s->media_valid && !s->writer && streamlink_source_join_share(s))
+		return;
+	if (!s->media_valid && !s->writer && streamlink_source_preparing(s)) {
+		// started by the tick once ready, the graphics thread never waits for the network here
+		s->start_deferred = true;
+		return;
+	}
+	if (!s->media_valid && !s->writer)
+		streamlink_source_adopt_prepared(s);
+	if (!s->media_valid && s->writer && s->writer->warm)
+		streamlink_source_resume(s);
+	else if (!s->media_valid)
+		streamlink_source_open(s);
+
+	if (s->media_valid) {
+		mp_media_play(&s->media, false, false);
+	}
+}
+
+// For the restart hotkey and media control. A running passthrough writer is left alone by `streamlink_source_start`,
+// so it is closed first.
+static void streamlink_source_reopen(struct streamlink_source *s)
+{
+	if (s->passthrough)
+		streamlink_source_close(s);
+	streamlink_source_start(s);
+}
+
+// Restarts the recording when its settings changed, the writer picks it up without reopening.
+static void streamlink_source_update_recording(struct streamlink_source *s, obs_data_t *settings)
+{
+	const bool record = obs_data_get_bool(settings, RECORD);
+	const std::string record_path = obs_data_get_string(settings, RECORD_PATH);
+	const long long record_segment_s = obs_data_get_int(settings, RECORD_SEGMENT);
+	if (record == s->record && record_path == s->record_path && record_segment_s == s->record_segment_s)
+		return;
+	s->record = record;
+	s->record_path = record_path;
+	s->record_segment_s = record_segment_s;
+
+	if (s->recording)
+		recorder_stop(s->recording);
+	s->recording = record && !record_path.empty()
+			       ? recorder_start(record_path, obs_source_get_name(s->source),
+						static_cast<uint32_t>(record_segment_s), RECORD_QUEUE_LIMIT)
+			       : nullptr;
+	if (s->writer)
+		pipe_writer_record(s->writer, s->recording);
+}
+
+// Starts over with an empty replay buffer when its size changed, the writer picks it up without reopening.
+static void streamlink_source_update_replay(struct streamlink_source *s, obs_data_t *settings)
+{
+	const bool replay_enabled = obs_data_get_bool(settings, REPLAY);
+	const long long replay_length_s = obs_data_get_int(settings, REPLAY_LENGTH);
+	const long long replay_memory_mb = obs_data_get_int(settings, REPLAY_MEMORY);
+	std::shared_ptr<replay_buffer> rb;
+	{
+		std::lock_guard lock{s->replay_mutex};
+		s->replay_path = obs_data_get_string(settings, REPLAY_PATH);
+		if (replay_enabled == s->replay_enabled && replay_length_s == s->replay_length_s &&
+		    replay_memory_mb == s->replay_memory_mb)
+			return;
+		s->replay_enabled = replay_enabled;
+		s->replay_length_s = replay_length_s;
+		s->replay_memory_mb = replay_memory_mb;
+
+		s->replay = replay_enabled ? replay_buffer_create(static_cast<size_t>(replay_memory_mb) * 1024 * 1024,
+								  static_cast<uint32_t>(replay_length_s))
+					   : nullptr;
+		rb = s->replay;
+	}
+	if (s->writer)
+		pipe_writer_replay(s->writer, std::move(rb));
+}
+
+// Listens again when the port changed, the writer picks the server up without reopening.
+static void streamlink_source_update_serve(struct streamlink_source *s, obs_data_t *settings)
+{
+	const bool serve_enabled = obs_data_get_bool(settings, SERVE);
+	const long long serve_port = obs_data_get_int(settings, SERVE_PORT);
+	if (serve_enabled == s->serve_enabled && (!serve_enabled || serve_port == s->serve_port))
+		return;
+	s->serve_enabled = serve_enabled;
+	s->serve_port = serve_port;
+
+	std::shared_ptr<http_server> hs;
+	{
+		std::lock_guard lock{s->serve_mutex};
+		if (s->serving)
+			http_server_stop(s->serving);
+		s->serving = serve_enabled ? http_server_start(obs_source_get_name(s->source),
+								 static_cast<uint16_t>(serve_port), SERVE_BUFFER_LIMIT)
+					   : nullptr;
+		s->serve_failed_ts = serve_enabled && !s->serving ? os_gettime_ns() : 0;
+		hs = s->serving;
+	}
+	if (s->writer)
+		pipe_writer_serve(s->writer, std::move(hs));
+}
+
+// Tries a port which could not be bound again every `SERVE_RETRY_NS`, e.g. once another program let go of it.
+static void streamlink_source_retry_serve(struct streamlink_source *s)
+{
+	std::shared_ptr<http_server> hs;
+	{
+		std::lock_guard lock{s->serve_mutex};
+		const uint64_t now = os_gettime_ns();
+		if (s->serving || s->serve_failed_ts == 0 || now - s->serve_failed_ts < SERVE_RETRY_NS)
+			return;
+		s->serving = http_server_start(obs_source_get_name(s->source), static_cast<uint16_t>(s->serve_port),
+					       SERVE_BUFFER_LIMIT, true);
+		s->serve_failed_ts = s->serving ? 0 : now;
+		hs = s->serving;
+	}
+	if (hs && s->writer)
+		pipe_writer_serve(s->writer, std::move(hs));
+}
+
+// Saves the last `seconds` of the replay buffer as a clip, all of it when 0.
+static int64_t streamlink_source_save_replay(struct streamlink_source *s, uint32_t seconds)
+{
+	std::shared_ptr<replay_buffer> rb;
+	std::string path;
+	uint32_t length = seconds;
+	{
+		// copied, `streamlink_source_update_replay` may replace them meanwhile
+		std::lock_guard lock{s->replay_mutex};
+		rb = s->replay;
+		path = s->replay_path;
+		if (length == 0)
+			length = static_cast<uint32_t>(s->replay_length_s);
+	}
+	if (!rb || path.empty())
+		return 0;
+	const int64_t saved_ms = replay_buffer_save(rb.get(), path, obs_source_get_name(s->source), length);
+	if (saved_ms > 0)
+		FF_BLOG(LOG_INFO, "saving the last %.1f s as a replay", static_cast<double>(saved_ms) / 1000.0);
+	else
+		FF_BLOG(LOG_INFO, "nothing to save as a replay yet");
+	return saved_ms;
+}
+
+static void streamlink_source_update(void *data, obs_data_t *settings)
+{
+	const auto s = static_cast<streamlink_source_t*>(data);
+
+	const bool transport_changed = !s->session_cfg || s->session_cfg->transport_differs(session_config::from_settings(settings));
+	update_streamlink_session(s, settings);
+
+	const auto live_room_url = obs_data_get_string(settings, URL);
+	const auto definition = obs_data_get_string(settings, DEFINITIONS);
+	const bool is_hw_decoding = obs_data_get_bool(settings, HW_DECODE);
+	pipe_filter filter{};
+	filter.mode = static_cast<media_mode>(obs_data_get_int(settings, MEDIA_MODE));
+	filter.keyframes_only = obs_data_get_bool(settings, KEYFRAMES_ONLY);
+	filter.keyframe_interval_ms = static_cast<uint32_t>(obs_data_get_int(settings, KEYFRAME_INTERVAL));
+	s->stop_timeout_ms = obs_data_get_int(settings, STOP_TIMEOUT);
+	s->seamless_switch = obs_data_get_bool(settings, SEAMLESS_SWITCH);
+	s->start_at_keyframe = obs_data_get_bool(settings, START_AT_KEYFRAME);
+	s->downscale = static_cast<downscale_mode>(obs_data_get_int(settings, DOWNSCALE));
+	s->downscale_fixed_width = static_cast<uint32_t>(obs_data_get_int(settings, DOWNSCALE_WIDTH));
+	s->downscale_fixed_height = static_cast<uint32_t>(obs_data_get_int(settings, DOWNSCALE_HEIGHT));
+	streamlink_source_update_max_size(s);
+	const bool reduce_to_420 = obs_data_get_bool(settings, REDUCE_TO_420);
+	if (reduce_to_420 && !s->reduce_to_420)
+		FF_BLOG(LOG_INFO, "reducing 10-bit and 4:2:2 frames to 8-bit 4:2:0 with %s kernels", pixel_convert_kernels());
+	s->reduce_to_420 = reduce_to_420;
+	s->keep_warm = obs_data_get_bool(settings, KEEP_WARM);
+	s->warm_buffer_limit_mb = obs_data_get_int(settings, WARM_BUFFER_LIMIT);
+	s->prewarm_timeout_s = obs_data_get_int(settings, PREWARM_TIMEOUT);
+	s->resolution_cache = obs_data_get_bool(settings, RESOLUTION_CACHE);
+	s->resolution_cache_ttl_min = obs_data_get_int(settings, RESOLUTION_CACHE_TTL);
+	s->share_decode = obs_data_get_bool(settings, SHARE_DECODE);
+	s->ring_buffer_auto = obs_data_get_bool(settings, RING_BUFFER_AUTO);
+	s->ring_buffer_seconds = obs_data_get_int(settings, RING_BUFFER_SECONDS);
+	// Mbps to bytes per second
+	s->bandwidth->source_cap = static_cast<uint64_t>(obs_data_get_int(settings, BANDWIDTH_LIMIT)) * 125000;
+	bandwidth_limit_adopt_total(static_cast<uint64_t>(obs_data_get_int(settings, BANDWIDTH_TOTAL_LIMIT)) * 125000);
+	streamlink_source_update_recording(s, settings);
+	streamlink_source_update_replay(s, settings);
+	streamlink_source_update_serve(s, settings);
+	const bool timeshift_enabled = obs_data_get_bool(settings, TIMESHIFT);
+	const long long timeshift_window_min = obs_data_get_int(settings, TIMESHIFT_WINDOW);
+	const long long timeshift_memory_mb = obs_data_get_int(settings, TIMESHIFT_MEMORY);
+	const bool timeshift_same = timeshift_enabled == s->timeshift_enabled &&
+				    (!timeshift_enabled || (timeshift_window_min == s->timeshift_window_min &&
+							    timeshift_memory_mb == s->timeshift_memory_mb));
+	s->timeshift_enabled = timeshift_enabled;
+	s->timeshift_window_min = timeshift_window_min;
+	s->timeshift_memory_mb = timeshift_memory_mb;
+	const bool passthrough = obs_data_get_bool(settings, PASSTHROUGH);
+	const bool passthrough_same = s->passthrough == passthrough;
+	s->passthrough = passthrough;
+
+	// Restart only for what the running stream or decoder can't pick up, harmless edits keep it playing.
+	const bool transport_same = !transport_changed && s->live_room_url == live_room_url && s->is_hw_decoding == is_hw_decoding &&
+				    s->filter == filter && timeshift_same && passthrough_same;
+	const bool definition_changed = s->selected_definition != definition;
+	if (s->live_room_url != live_room_url)
+		s->full_probe = false;
+	if (s->live_room_url != live_room_url || definition_changed)
+		streamlink_source_reset_vod(s);
+	// tuning starts over from the configured settings for another stream
+	const bool hls_auto = obs_data_get_bool(settings, HLS_AUTO);
+	if (!hls_auto || hls_auto != s->hls_auto || s->live_room_url != live_room_url) {
+		s->hls_live_edge = obs_data_get_int(settings, HLS_LIVE_EDGE);
+		s->hls_segment_threads = obs_data_get_int(settings, HLS_SEGMENT_THREADS);
+		s->hls_calm = 0;
+	}
+	s->hls_auto = hls_auto;
+	// the session may just have been given the configured settings again
+	if (hls_auto)
+		streamlink_source_apply_hls(s);
+	s->live_room_url = live_room_url;
+	s->selected_definition = definition;
+	s->is_hw_decoding = is_hw_decoding;
+	s->filter = filter;
+
+	// an owner keeps decoding, it only stops sharing what no longer matches
+	const auto share_key = streamlink_source_share_key(s);
+	const bool share_same = s->share_key == share_key;
+	s->share_key = share_key;
+	if (!share_same && s->shared) {
+		streamlink_source_end_share(s, true);
+		if (s->media_valid)
+			streamlink_source_own_share(s);
+	}
+
+	// stops fetching once nothing takes the stream any more, `streamlink_source_start` says why
+	if (s->passthrough && s->writer && !streamlink_source_passthrough_used(s))
+		streamlink_source_close(s);
+	if (transport_same && !definition_changed && (s->media_valid || s->writer || (s->subscribed && share_same)))
+		return;
+	// "auto (fit)" picks when resolving, switching to it takes a reopen
+	if (transport_same && s->media_valid && s->seamless_switch && definition != std::string(DEFINITION_AUTO_FIT) &&
+	    streamlink_source_switch(s, s->selected_definition))
+		return;
+
+	streamlink_source_close(s);
+	bool showing = obs_source_showing(s->source);
+
+	if (showing || s->passthrough)
+		streamlink_source_start(s);
+}
+
+static const char *streamlink_source_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("StreamlinkSource");
+}
+
+static void restart_hotkey(void *data, obs_hotkey_id id, obs_hotkey_t *hotkey,
+			   bool pressed)
+{
+	UNUSED_PARAMETER(id);
+	UNUSED_PARAMETER(hotkey);
+	UNUSED_PARAMETER(pressed);
+
+	const auto s = static_cast<streamlink_source_t*>(data);
+	if (obs_source_active(s->source) || s->passthrough)
+		streamlink_source_reopen(s);
+}
+
+static void replay_hotkey(void *data, obs_hotkey_id id, obs_hotkey_t *hotkey, bool pressed)
+{
+	UNUSED_PARAMETER(id);
+	UNUSED_PARAMETER(hotkey);
+
+	if (pressed)
+		streamlink_source_save_replay(static_cast<streamlink_source_t*>(data), 0);
+}
+
+static void get_stats_proc(void *data, calldata_t *cd)
+{
+	const auto s = static_cast<streamlink_source_t*>(data);
+	const auto w = s->writer;
+	calldata_set_int(cd, "warm_buffer_bytes", w ? static_cast<long long>(w->warm_bytes.load()) : 0);
+	calldata_set_int(cd, "warm_buffer_peak_bytes", w ? static_cast<long long>(w->warm_peak.load()) : 0);
+	calldata_set_float(cd, "decode_fps", s->decode_fps);
+	calldata_set_float(cd, "decode_ms_per_s", s->decode_ms_per_s);
+	calldata_set_float(cd, "convert_ms_per_frame", s->convert_ms);
+	long long subscribers = 0;
+	{
+		std::lock_guard lock{s->share_mutex};
+		if (s->shared)
+			subscribers = static_cast<long long>(shared_decode_subscribers(s->shared).size());
+	}
+	calldata_set_int(cd, "decode_subscribers", subscribers);
+	calldata_set_bool(cd, "decode_shared", s->subscribed != nullptr);
+	const auto r = s->recording;
+	calldata_set_int(cd, "record_bytes_written", r ? static_cast<long long>(r->bytes_written.load()) : 0);
+	calldata_set_int(cd, "record_bytes_dropped", r ? static_cast<long long>(r->bytes_dropped.load()) : 0);
+	calldata_set_int(cd, "record_queue_bytes", r ? static_cast<long long>(r->queue_bytes.load()) : 0);
+	const auto rb = streamlink_source_replay(s);
+	calldata_set_int(cd, "replay_bytes", rb ? static_cast<long long>(rb->bytes_held.load()) : 0);
+	const auto hs = streamlink_source_serving(s);
+	calldata_set_bool(cd, "serve_listening", hs != nullptr);
+	calldata_set_int(cd, "serve_clients", hs ? static_cast<long long>(hs->clients.load()) : 0);
+	calldata_set_int(cd, "serve_bytes_sent", hs ? static_cast<long long>(hs->bytes_sent.load()) : 0);
+	calldata_set_float(cd, "input_bytes_per_s", s->input_bytes_per_s);
+	calldata_set_int(cd, "ring_buffer_bytes", static_cast<long long>(buffer_budget_size(s)));
+	calldata_set_int(cd, "ring_buffer_total_bytes", static_cast<long long>(buffer_budget_total()));
+	calldata_set_int(cd, "hls_live_edge", s->hls_live_edge);
+	calldata_set_int(cd, "hls_segment_threads", s->hls_segment_threads);
+	calldata_set_int(cd, "hls_stalls", static_cast<long long>(s->hls_stalls));
+	const auto &bl = s->bandwidth;
+	calldata_set_int(cd, "bandwidth_rate", static_cast<long long>(bl->rate.load()));
+	calldata_set_int(cd, "bandwidth_bytes_read", static_cast<long long>(bl->bytes_read.load()));
+	calldata_set_int(cd, "bandwidth_throttled_ms", static_cast<long long>(bl->throttled_ns.load() / 1000000));
+	const auto shift = w && w->shift ? timeshift_get_stats(w->shift.get()) : timeshift_stats{};
+	calldata_set_int(cd, "timeshift_bytes", static_cast<long long>(shift.bytes));
+	calldata_set_int(cd, "timeshift_capacity_bytes", static_cast<long long>(shift.capacity));
+	calldata_set_int(cd, "timeshift_duration_ms", shift.duration_ms);
+	calldata_set_int(cd, "timeshift_position_ms", shift.position_ms);
+}
+
+// Only asks for it, everything preparing reads belongs to the graphics thread.
+static void prepare_proc(void *data, calldata_t *cd)
+{
+	UNUSED_PARAMETER(cd);
+	static_cast<streamlink_source_t*>(data)->prepare_requested = true;
+}
+
+static void save_replay_proc(void *data, calldata_t *cd)
+{
+	const long long seconds = calldata_int(cd, "seconds");
+	const int64_t saved_ms = streamlink_source_save_replay(static_cast<streamlink_source_t*>(data),
+							       static_cast<uint32_t>(std::max(0LL, seconds)));
+	calldata_set_int(cd, "saved_ms", saved_ms);
+}
+
+static void streamlink_source_destroy(void* data);
+
+static void *streamlink_source_create(obs_data_t *settings, obs_source_t *source)
+{
+	const auto s = new streamlink_source{};
+
+	s->source = source;
+	s->available_definitions = std::vector<std::string>{};
+	s->bandwidth = bandwidth_limit_register();
 
 	s->hotkey = obs_hotkey_register_source(source, "StreamlinkSource.Restart",
 					       obs_module_text("RestartMedia"),
 					       restart_hotkey, s);
+	s->replay_hotkey = obs_hotkey_register_source(source, "StreamlinkSource.SaveReplay",
+						      obs_module_text("SaveReplay"), replay_hotkey, s);
+	proc_handler_t *ph = obs_source_get_proc_handler(source);
+	proc_handler_add(ph, "void get_stats(out int warm_buffer_bytes, out int warm_buffer_peak_bytes, "
+			     "out float decode_fps, out float decode_ms_per_s, out float convert_ms_per_frame, out int decode_subscribers, "
+			     "out bool decode_shared, out int record_bytes_written, out int record_bytes_dropped, out int record_queue_bytes, "
+			     "out int replay_bytes, out bool serve_listening, out int serve_clients, out int serve_bytes_sent, out float input_bytes_per_s, out int ring_buffer_bytes, out int ring_buffer_total_bytes, out int hls_live_edge, out int hls_segment_threads, out int hls_stalls, out int bandwidth_rate, out int bandwidth_bytes_read, out int bandwidth_throttled_ms, out int timeshift_bytes, out int timeshift_capacity_bytes, out int timeshift_duration_ms, out int timeshift_position_ms)", get_stats_proc, s);
+	proc_handler_add(ph, "void prepare()", prepare_proc, s);
+	proc_handler_add(ph, "void save_replay(in int seconds, out int saved_ms)", save_replay_proc, s);
 	s->selected_definition = "best";  // linux: not using std::string{...} here because of segfault on __memmove_avx_unaligned_erms()
 
 	if (!update_streamlink_session(s, settings)) {
@@ -520,6 +2426,13 @@ static void *streamlink_source_create(obs_data_t *settings, obs_source_t *source
 	}
 
 	streamlink_source_update(s, settings);
+	// nothing is showing yet while a scene collection loads, resolve every source at once instead of one by one on
+	// show; opening waits for the show, most scenes of a collection are never shown
+	if (!obs_source_showing(source)) {
+		load_batch_join(s);
+		if (!streamlink_source_queue_prepare(s, false))
+			load_batch_leave(s, false);
+	}
 	return s;
 }
 
@@ -529,48 +2442,201 @@ static void streamlink_source_destroy(void *data)
 
 	if (s->hotkey)
 		obs_hotkey_unregister(s->hotkey);
-	if (s->media_valid)
+	if (s->replay_hotkey)
+		obs_hotkey_unregister(s->replay_hotkey);
+
+	streamlink_source_wait_prepared(s);
+	streamlink_source_close(s);
+	if (s->recording)
+		recorder_stop(s->recording);
+	if (const auto hs = streamlink_source_serving(s))
+		http_server_stop(hs);
+	load_batch_leave(s, false);
+	buffer_budget_remove(s);
+	bandwidth_limit_unregister(s->bandwidth.get());
+	s->streamlink_session.reset();
+	delete s;
+}
+
+static void streamlink_source_show(void *data)
+{
+	const auto s = static_cast<streamlink_source_t*>(data);
+	// never stopped while hidden, restarting playback would only reopen it
+	const bool kept = std::exchange(s->kept_for_subscribers, false);
+	if (kept && s->media_valid)
+		return;
+	streamlink_source_start(s);
+}
+
+static void streamlink_source_stop_showing(struct streamlink_source *s)
+{
+	if (s->keep_warm && !s->timeshift_enabled && s->media_valid && s->writer)
+		streamlink_source_keep_warm(s);
+	else
+		streamlink_source_close(s);
+	obs_source_output_video(s->source, nullptr);
+}
+
+static void streamlink_source_hide(void *data)
+{
+	const auto s = static_cast<streamlink_source_t*>(data);
+
+	if (s->passthrough)
+		return;
+	// other sources still show what this one decodes, `streamlink_source_tick` stops once they are gone
+	if (streamlink_source_has_subscribers(s)) {
+		s->kept_for_subscribers = true;
+		return;
+	}
+	streamlink_source_stop_showing(s);
+}
+
+// Moves playback to `position_ms` into the timeshift, or back to live when negative. The decoder is reopened on a
+// fresh pipe, which the writer starts at the nearest keyframe, once `streamlink_source_finish_seek` sees it exists.
+static void streamlink_source_timeshift_seek(struct streamlink_source *s, int64_t position_ms)
+{
+	if (!s->timeshift_enabled || !s->writer)
+		return;
+	std::unique_lock lock{s->seek_mutex};
+	// a seek still waiting for its pipe is replaced
+	if (!s->media_valid && s->seek_pipe_path.empty())
+		return;
+	if (s->media_valid) {
+		// cleared first, so `media_stopped` doesn't schedule a full close
+		s->media_valid = false;
 		mp_media_free(&s->media);
+	}
+	const auto pipe_path = streamlink_source_next_pipe_path(s);
+	if (!pipe_writer_seek(s->writer, pipe_path, position_ms)) {
+		s->seek_pipe_path.clear();
+		lock.unlock();
+		FF_BLOG(LOG_WARNING, "timeshift: seeking failed, reopening");
+		streamlink_source_close(s);
+		streamlink_source_start(s);
+		return;
+	}
+	s->seek_pipe_path = pipe_path;
+	s->seek_ts = os_gettime_ns();
+}
 
-	if (s->stop_signal) {
-	    os_event_signal(s->stop_signal);
+// Sets up the decoder on the pipe of a timeshift seek once the feeder created it, or reopens when it could not.
+static void streamlink_source_finish_seek(struct streamlink_source *s)
+{
+	std::string pipe_path;
+	{
+		std::lock_guard lock{s->seek_mutex};
+		if (s->seek_pipe_path.empty())
+			return;
+		const seek_state state = s->writer ? s->writer->seek.load() : seek_state::failed;
+		if (state == seek_state::waiting && os_gettime_ns() - s->seek_ts < SEEK_TIMEOUT_NS)
+			return;
+		if (state == seek_state::ready)
+			pipe_path = s->seek_pipe_path;
+		s->seek_pipe_path.clear();
 	}
-#ifdef _WIN32
-	if (s->thread.p) {
-#else
-	if (s->thread) {
-#endif
-	    pthread_join(s->thread, nullptr);
+	if (pipe_path.empty()) {
+		FF_BLOG(LOG_WARNING, "timeshift: seeking failed, reopening");
+		streamlink_source_close(s);
+		streamlink_source_start(s);
+		return;
 	}
-	if (s->stop_signal) {
-	    os_event_destroy(s->stop_signal);
+	streamlink_source_init_media(s, pipe_path);
+	if (s->media_valid)
+		mp_media_play(&s->media, false, false);
+}
+
+// Reopens a VOD at the start of the segment holding `position_ms`, streamlink fetches from that segment on instead
+// of reading everything before it. False when the stream is not known to be a VOD.
+static bool streamlink_source_vod_seek(struct streamlink_source *s, int64_t position_ms)
+{
+	{
+		std::lock_guard lock{s->vod_mutex};
+		const auto &starts = s->vod_segment_starts_ms;
+		if (starts.empty())
+			return false;
+		auto it = std::upper_bound(starts.begin(), starts.end(), std::max<int64_t>(position_ms, 0));
+		if (it != starts.begin())
+			--it;
+		s->vod_start_ms = *it;
 	}
+	FF_BLOG(LOG_INFO, "VOD: seeking to %.1f s", static_cast<double>(s->vod_start_ms) / 1000.0);
+	const bool paused = s->media_valid && s->media.pause;
+	streamlink_source_close(s);
+	streamlink_source_start(s);
+	if (paused && s->media_valid)
+		mp_media_play_pause(&s->media, true);
+	return true;
+}
 
-	streamlink_close(s);
-	s->streamlink_session.reset();
-	bfree(s);
+// OBS shows media controls for every source of a type, these are the ones they act on. A live stream without a
+// timeshift has nowhere to go while paused and nothing to seek in: pause and seek do nothing, its duration and time
+// stay 0 so that there is no position to drag, and only restart, which reopens it, works.
+static bool streamlink_source_controllable(struct streamlink_source *s)
+{
+	return s->timeshift_enabled || s->vod_duration_ms > 0;
 }
 
-static void streamlink_source_show(void *data)
+static void streamlink_source_play_pause(void *data, bool pause)
 {
 	const auto s = static_cast<streamlink_source_t*>(data);
-	streamlink_source_start(s);
+	if (streamlink_source_controllable(s) && s->media_valid)
+		mp_media_play_pause(&s->media, pause);
 }
 
-static void streamlink_source_hide(void *data)
+static void streamlink_source_restart(void *data)
 {
 	const auto s = static_cast<streamlink_source_t*>(data);
+	if (streamlink_source_vod_seek(s, 0))
+		return;
+	if (s->timeshift_enabled && s->media_valid) {
+		streamlink_source_timeshift_seek(s, -1);
+		return;
+	}
+	if (obs_source_showing(s->source) || s->passthrough)
+		streamlink_source_reopen(s);
+}
 
-	if (s->media_valid)
-		mp_media_stop(&s->media);
-	obs_source_output_video(s->source, nullptr);
-	streamlink_close(s);
+static int64_t streamlink_source_get_duration(void *data)
+{
+	const auto s = static_cast<streamlink_source_t*>(data);
+	if (const int64_t vod_duration_ms = s->vod_duration_ms)
+		return vod_duration_ms;
+	const auto w = s->writer;
+	return w && w->shift ? timeshift_get_stats(w->shift.get()).duration_ms : 0;
+}
+
+static int64_t streamlink_source_get_time(void *data)
+{
+	const auto s = static_cast<streamlink_source_t*>(data);
+	if (s->vod_duration_ms > 0)
+		return s->vod_start_ms + s->vod_played_ms;
+	const auto w = s->writer;
+	return w && w->shift ? timeshift_get_stats(w->shift.get()).position_ms : 0;
+}
+
+static void streamlink_source_set_time(void *data, int64_t ms)
+{
+	const auto s = static_cast<streamlink_source_t*>(data);
+	if (!streamlink_source_controllable(s))
+		return;
+	if (!streamlink_source_vod_seek(s, ms))
+		streamlink_source_timeshift_seek(s, ms);
+}
+
+static enum obs_media_state streamlink_source_get_state(void *data)
+{
+	const auto s = static_cast<streamlink_source_t*>(data);
+	if (s->subscribed)
+		return OBS_MEDIA_STATE_PLAYING;
+	if (!s->media_valid)
+		return s->writer ? OBS_MEDIA_STATE_OPENING : OBS_MEDIA_STATE_STOPPED;
+	return s->media.pause && streamlink_source_controllable(s) ? OBS_MEDIA_STATE_PAUSED : OBS_MEDIA_STATE_PLAYING;
 }
 
 extern "C" obs_source_info streamlink_source_info = {
 	.id = "streamlink_source",
 	.type = OBS_SOURCE_TYPE_INPUT,
-	.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_AUDIO | OBS_SOURCE_DO_NOT_DUPLICATE,
+	.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_AUDIO | OBS_SOURCE_DO_NOT_DUPLICATE | OBS_SOURCE_CONTROLLABLE_MEDIA,
 	.get_name = streamlink_source_getname,
 	.create = streamlink_source_create,
 	.destroy = streamlink_source_destroy,
@@ -580,4 +2646,10 @@ extern "C" obs_source_info streamlink_source_info = {
 	.show = streamlink_source_show, .hide = streamlink_source_hide,
 	.video_tick = streamlink_source_tick,
 	.icon_type = OBS_ICON_TYPE_MEDIA,
+	.media_play_pause = streamlink_source_play_pause,
+	.media_restart = streamlink_source_restart,
+	.media_get_duration = streamlink_source_get_duration,
+	.media_get_time = streamlink_source_get_time,
+	.media_set_time = streamlink_source_set_time,
+	.media_get_state = streamlink_source_get_state,
 };  // NOLINT(clang-diagnostic-missing-field-initializers)
@@ -0,0 +1,180 @@
+#include "timeshift.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+
+// audio only programs get a point about this often
+constexpr uint64_t AUDIO_POINT_INTERVAL_PTS = 90000;
+
+static uint64_t pts_distance(uint64_t from, uint64_t to)
+{
+	return (to - from) & mpegts::PtsMask;
+}
+
+std::unique_ptr<timeshift> timeshift_create(size_t capacity, uint32_t window_s)
+{
+	auto t = std::make_unique<timeshift>();
+	t->capacity = capacity;
+	t->window_pts = static_cast<uint64_t>(window_s) * 90000;
+	// not value-initialized, so that it isn't all written to before it fills
+	t->ring.reset(new (std::nothrow) char[capacity]);
+	if (!t->ring)
+		return nullptr;
+	return t;
+}
+
+static void timeshift_index(timeshift *t, const char *data, size_t size)
+{
+	t->inspector.Feed(data, size, [t](const uint8_t *, size_t packet_size, const mpegts::PacketInfo *info) {
+		const uint64_t offset = t->indexed + t->inspector.Skipped();
+		t->indexed += packet_size;
+		if (!info)
+			return;
+		if (info->isPmt) {
+			t->psi.assign(t->inspector.LastPat().begin(), t->inspector.LastPat().end());
+			t->psi.insert(t->psi.end(), t->inspector.LastPmt().begin(), t->inspector.LastPmt().end());
+		}
+		if (info->hasPts) {
+			t->latest_pts = info->pts;
+			t->has_pts = true;
+		}
+		const bool no_video = !t->inspector.Streams().empty() && t->inspector.VideoPid() == mpegts::NullPid;
+		bool point = info->randomAccess;
+		if (no_video && info->kind == mpegts::StreamKind::Audio && info->hasPts)
+			point = t->points.empty() || pts_distance(t->points.back().pts, info->pts) >= AUDIO_POINT_INTERVAL_PTS;
+		if (point)
+			t->points.push_back({offset, t->latest_pts});
+	});
+}
+
+static void timeshift_evict(timeshift *t)
+{
+	if (t->end - t->begin > t->capacity)
+		t->begin = t->end - t->capacity;
+	// only whole points are worth keeping around for the window
+	if (t->has_pts) {
+		bool aged = false;
+		while (t->points.size() > 1 && pts_distance(t->points[1].pts, t->latest_pts) >= t->window_pts) {
+			t->points.pop_front();
+			aged = true;
+		}
+		if (aged)
+			t->begin = std::max(t->begin, t->points.front().offset);
+	}
+	while (!t->points.empty() && t->points.front().offset < t->begin)
+		t->points.pop_front();
+
+	if (t->cursor < t->begin) {
+		// the reader fell out of the window, it goes on from the oldest point left
+		t->cursor = t->points.empty() ? t->begin : t->points.front().offset;
+		t->resync = true;
+	}
+}
+
+void timeshift_append(timeshift *t, const char *data, size_t size)
+{
+	std::lock_guard lock{t->mutex};
+	timeshift_index(t, data, size);
+
+	if (size > t->capacity) {
+		t->end += size - t->capacity;
+		data += size - t->capacity;
+		size = t->capacity;
+	}
+	while (size > 0) {
+		const size_t pos = static_cast<size_t>(t->end % t->capacity);
+		const size_t n = std::min(size, t->capacity - pos);
+		std::copy(data, data + n, t->ring.get() + pos);
+		data += n;
+		size -= n;
+		t->end += n;
+	}
+	timeshift_evict(t);
+	t->cv.notify_all();
+}
+
+void timeshift_end(timeshift *t)
+{
+	std::lock_guard lock{t->mutex};
+	t->ended = true;
+	t->cv.notify_all();
+}
+
+void timeshift_take(timeshift *t, std::vector<char> &out, size_t max, unsigned long timeout_ms)
+{
+	out.clear();
+	std::unique_lock lock{t->mutex};
+	const auto ready = [t] { return t->cursor < t->end || t->resync || t->ended; };
+	if (!t->cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready))
+		return;
+
+	if (t->resync) {
+		out = t->psi;
+		t->resync = false;
+	}
+	size_t size = static_cast<size_t>(std::min<uint64_t>(max, t->end - t->cursor));
+	while (size > 0) {
+		const size_t pos = static_cast<size_t>(t->cursor % t->capacity);
+		const size_t n = std::min(size, t->capacity - pos);
+		out.insert(out.end(), t->ring.get() + pos, t->ring.get() + pos + n);
+		size -= n;
+		t->cursor += n;
+	}
+}
+
+bool timeshift_drained(timeshift *t)
+{
+	std::lock_guard lock{t->mutex};
+	return t->ended && t->cursor == t->end;
+}
+
+void timeshift_interrupt(timeshift *t)
+{
+	t->cv.notify_all();
+}
+
+bool timeshift_seek(timeshift *t, int64_t position_ms)
+{
+	std::lock_guard lock{t->mutex};
+	if (t->points.empty())
+		return false;
+	const uint64_t first_pts = t->points.front().pts;
+	const uint64_t target = static_cast<uint64_t>(std::max<int64_t>(position_ms, 0)) * 90;
+	// PTS only grow within the window, short of a discontinuity
+	auto it = std::partition_point(t->points.begin(), t->points.end(), [&](const timeshift_point &p) {
+		return pts_distance(first_pts, p.pts) <= target;
+	});
+	if (it != t->points.begin())
+		--it;
+	t->cursor = it->offset;
+	t->resync = true;
+	t->cv.notify_all();
+	return true;
+}
+
+bool timeshift_live(timeshift *t)
+{
+	std::lock_guard lock{t->mutex};
+	if (t->points.empty())
+		return false;
+	t->cursor = t->points.back().offset;
+	t->resync = true;
+	t->cv.notify_all();
+	return true;
+}
+
+timeshift_stats timeshift_get_stats(timeshift *t)
+{
+	std::lock_guard lock{t->mutex};
+	timeshift_stats stats{static_cast<size_t>(t->end - t->begin), t->capacity, 0, 0};
+	if (t->points.empty())
+		return stats;
+	const uint64_t first_pts = t->points.front().pts;
+	stats.duration_ms = static_cast<int64_t>(pts_distance(first_pts, t->latest_pts) / 90);
+	auto it = std::partition_point(t->points.begin(), t->points.end(),
+				       [&](const timeshift_point &p) { return p.offset <= t->cursor; });
+	if (it != t->points.begin())
+		stats.position_ms = static_cast<int64_t>(pts_distance(first_pts, std::prev(it)->pts) / 90);
+	return stats;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "mpegts.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Where decoding can start over: a video keyframe, or for audio only programs an audio PES about once a second.
+struct timeshift_point {
+	uint64_t offset;
+	uint64_t pts;
+};
+
+// The most recent input of a source kept in memory, so that playback can be paused, rewound and brought back to live
+// while the stream keeps coming in. Holds at most `capacity` bytes and `window_pts` worth of PTS, whichever is less.
+// All of the memory is allocated up front: Linux and macOS only back pages once written, Windows commits it at once.
+struct timeshift {
+	size_t capacity{};
+	uint64_t window_pts{};
+	std::unique_ptr<char[]> ring;
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	// absolute offsets of what the ring holds, and of the next byte to hand to the decoder
+	uint64_t begin{};
+	uint64_t end{};
+	uint64_t cursor{};
+	// the next byte taken is preceded by the latest PAT/PMT, after a jump
+	bool resync{};
+	bool ended{};
+	std::deque<timeshift_point> points{};
+	std::vector<char> psi{};
+
+	// indexes what is appended, which comes out in order minus what it skips
+	mpegts::Inspector inspector;
+	uint64_t indexed{};
+	uint64_t latest_pts{};
+	bool has_pts{};
+};
+
+// Null when `capacity` bytes can't be allocated.
+std::unique_ptr<timeshift> timeshift_create(size_t capacity, uint32_t window_s);
+// Never blocks on the reader; what falls out of the window is gone, even if the reader didn't get to it yet.
+void timeshift_append(timeshift *t, const char *data, size_t size);
+// No more is coming, `timeshift_take` returns what is left and then nothing.
+void timeshift_end(timeshift *t);
+// Copies up to `max` bytes from the cursor into `out`, waiting up to `timeout_ms` for any. Empty on timeout, or
+// once ended and drained, see `timeshift_drained`.
+void timeshift_take(timeshift *t, std::vector<char> &out, size_t max, unsigned long timeout_ms);
+bool timeshift_drained(timeshift *t);
+// Wakes up a `timeshift_take`.
+void timeshift_interrupt(timeshift *t);
+
+// Moves the cursor to the latest point at or before `position_ms` from the start of the window. False without any.
+bool timeshift_seek(timeshift *t, int64_t position_ms);
+// Moves the cursor to the latest point.
+bool timeshift_live(timeshift *t);
+
+struct timeshift_stats {
+	size_t bytes;
+	size_t capacity;
+	int64_t duration_ms;
+	int64_t position_ms;
+};
+timeshift_stats timeshift_get_stats(timeshift *t);
@@ -8,5 +8,8 @@
 #define FF_LOG_S(source, level, format, ...) \
     blog(level, "[Streamlink Source '%s']: " format, obs_source_get_name(source), ##__VA_ARGS__)
 
+#define FF_LOG_N(name, level, format, ...) \
+    blog(level, "[Streamlink Source '%s']: " format, name, ##__VA_ARGS__)
+
 #define FF_BLOG(level, format, ...) \
     FF_LOG_S(s->source, level, format, ##__VA_ARGS__)
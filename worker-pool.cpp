@@ -0,0 +1,65 @@
+#include "worker-pool.hpp"
+
+#include <util/threading.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+static std::mutex pool_mutex;
+static std::condition_variable pool_cv;
+static std::deque<std::function<void()>> pool_tasks;
+static std::vector<pthread_t> pool_threads;
+static unsigned pool_idle = 0;
+static bool pool_shutdown = false;
+
+static void *worker_thread(void *)
+{
+	os_set_thread_name("streamlink_worker");
+
+	std::unique_lock lock{pool_mutex};
+	while (true) {
+		pool_idle++;
+		pool_cv.wait(lock, [] { return pool_shutdown || !pool_tasks.empty(); });
+		pool_idle--;
+		if (pool_shutdown)
+			break;
+		auto task = std::move(pool_tasks.front());
+		pool_tasks.pop_front();
+
+		lock.unlock();
+		task();
+		lock.lock();
+	}
+	return nullptr;
+}
+
+void worker_pool_submit(std::function<void()> task)
+{
+	std::lock_guard lock{pool_mutex};
+	if (pool_shutdown)
+		return;
+	pool_tasks.push_back(std::move(task));
+	// threads are only added while every existing one is busy
+	if (pool_idle < pool_tasks.size() && pool_threads.size() < WORKER_POOL_SIZE) {
+		pthread_t thread;
+		if (pthread_create(&thread, nullptr, worker_thread, nullptr) == 0)
+			pool_threads.push_back(thread);
+	}
+	pool_cv.notify_one();
+}
+
+void worker_pool_shutdown()
+{
+	std::vector<pthread_t> threads;
+	{
+		std::lock_guard lock{pool_mutex};
+		pool_shutdown = true;
+		pool_tasks.clear();
+		threads.swap(pool_threads);
+	}
+	pool_cv.notify_all();
+	for (const auto thread : threads)
+		pthread_join(thread, nullptr);
+}
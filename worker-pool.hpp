@@ -0,0 +1,11 @@
+#pragma once
+
+#include <functional>
+
+// A few threads shared by every source, for blocking work which must not run on the graphics thread, like resolving
+// and opening streams. At most `WORKER_POOL_SIZE` tasks run at once, the rest wait in order.
+constexpr unsigned WORKER_POOL_SIZE = 8;
+
+void worker_pool_submit(std::function<void()> task);
+// Drops tasks not started yet and waits for the running ones.
+void worker_pool_shutdown();